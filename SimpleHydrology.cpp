@@ -3,13 +3,17 @@
 #include <TinyEngine/image>
 
 #include "source/vertexpool.h"
+#include "source/instancepool.h"
 #include "source/world.h"
+#include "source/mesh.h"
 #include "source/model.h"
 
 #include <random>
 
 mappool::pool<quad::cell> cellpool;
 Vertexpool<Vertex> vertexpool;
+Instancepool<TreeInstance> treepool;
+std::vector<float> treeheight;      // Terrain Height of each Tree Instance
 
 int main( int argc, char* args[] ) {
 
@@ -33,22 +37,33 @@ int main( int argc, char* args[] ) {
     srand(World::SEED);
   }
 
+  if(argc >= 3)
+    quad::resize(std::stoi(args[2]));
+
+  if(argc >= 4)
+    quad::terrain::cache = args[3];
+
   cellpool.reserve(quad::area);
   vertexpool.reserve(quad::tilearea, quad::maparea);
-  World::map.init(vertexpool, cellpool, World::SEED);
+  parallel::pool generators(std::thread::hardware_concurrency());
+  World::map.init(cellpool, generators, World::SEED);
+  quad::mesh(vertexpool, World::map);
+
+  if(!stats::open("stats.csv"))
+    std::cout<<"Failed to open stats.csv"<<std::endl;
 
   //Vertexpool for Drawing Surface
 
   for(auto& node: world.map.nodes){
-    updatenode(vertexpool, node);
+    updatenode(vertexpool, world.map, node);
   }
 
   // Initialize the Visualization
 
   // Camera
 
-  cam::near = -800.0f;
-  cam::far = 800.0f;
+  cam::near = -800.0f*quad::mapsize;
+  cam::far = 800.0f*quad::mapsize;
   cam::moverate = 10.0f;
   cam::look = glm::vec3(quad::size/2, quad::mapscale/2, quad::size/2);
   cam::roty = 60.0f;
@@ -56,13 +71,15 @@ int main( int argc, char* args[] ) {
   cam::init(3, cam::ORTHO);
   cam::update();
 
+  initdepth();
+
   //Setup Shaders
 
   Shader defaultshader({"source/shader/default.vs", "source/shader/default.fs"}, {"in_Position", "in_Normal", "in_Tangent", "in_Bitangent"});
   Shader defaultdepth({"source/shader/depth.vs", "source/shader/depth.fs"}, {"in_Position"});
 
-  Shader treeshader({"source/shader/tree.vs", "source/shader/tree.fs"}, {"in_Pos", "in_Model"});
-  Shader treedepth({"source/shader/treedepth.vs", "source/shader/treedepth.fs"}, {"in_Pos", "in_Model"});
+  Shader treeshader({"source/shader/tree.vs", "source/shader/tree.fs"}, {"in_Pos", "in_Tree"});
+  Shader treedepth({"source/shader/treedepth.vs", "source/shader/treedepth.fs"}, {"in_Pos", "in_Tree"});
 
   Shader ssaoshader({"source/shader/ssao.vs", "source/shader/ssao.fs"}, {"in_Quad", "in_Tex"});
   Shader imageshader({"source/shader/image.vs", "source/shader/image.fs"}, {"in_Quad", "in_Tex"});
@@ -155,12 +172,9 @@ int main( int argc, char* args[] ) {
   conemodel.bind<vec3>("in_Normal", &conenormalbuf);
   conemodel.SIZE = 16*3;
 
-  //Trees as a Particle System
+  //Trees as a Particle System (Instances in a Persistently Mapped Ring)
 
-  Instance treeparticle(&conemodel);	//Particle system based on this model
-  Buffer modelbuf;
-  treeparticle.bind<glm::mat4>("in_Model", &modelbuf);			//Update treeparticle system
-  std::vector<glm::mat4> treemodels;
+  treepool.reserve(conemodel.vao, 2, Vegetation::plants.size());
 
   //Texture for Hydrological Map Visualization
 
@@ -216,6 +230,20 @@ int main( int argc, char* args[] ) {
       dbvp = bias*dvp;
 
     }
+
+    #ifdef HYDROLOGY_STATS
+    if(ImGui::CollapsingHeader("Statistics (Last Frame)")){
+      ImGui::Text("Drops: %lu spawned, %lu rejected", stats::last[stats::SPAWNED], stats::last[stats::REJECTED]);
+      ImGui::Text("Died: %lu age, %lu volume, %lu out-of-bounds", stats::last[stats::DIED_AGE], stats::last[stats::DIED_VOLUME], stats::last[stats::DIED_OOB]);
+      ImGui::Text("Mean Age: %.1f", stats::meanage());
+      ImGui::Text("Cascade Transfers: %lu", stats::last[stats::TRANSFERS]);
+      ImGui::Text("Plants: %lu born, %lu died, %lu total", stats::last[stats::BORN], stats::last[stats::DIED], Vegetation::plants.size());
+      ImGui::Text("Tree Instances: %lu written, %lu total", treepool.written, treepool.SIZE);
+      for(int p = 0; p < stats::PHASES; p++)
+        ImGui::Text("%s: %.2f ms", stats::phasenames[p], 1000.0*stats::lastelapsed[p]);
+    }
+    #endif
+
     ImGui::End();
   };
 
@@ -242,7 +270,7 @@ int main( int argc, char* args[] ) {
       treeshader.uniform("proj", cam::proj);
       treeshader.uniform("view", cam::view);
       treeshader.uniform("color", treeColor);
-      treeparticle.render(GL_TRIANGLES);
+      treepool.render(GL_TRIANGLES, conemodel.SIZE);
 
     }
 
@@ -271,7 +299,7 @@ int main( int argc, char* args[] ) {
       //Render the Trees as a Particle System
       treedepth.use();
       treedepth.uniform("dvp", dvp);
-      treeparticle.render(GL_TRIANGLES);
+      treepool.render(GL_TRIANGLES, conemodel.SIZE);
 
     }
 
@@ -310,7 +338,6 @@ int main( int argc, char* args[] ) {
 
   };
 
-  int n = 0;
   Tiny::loop([&](){
 
     if(paused)
@@ -319,39 +346,64 @@ int main( int argc, char* args[] ) {
     world.erode(quad::tilesize); //Execute Erosion Cycles
     Vegetation::grow();     //Grow Trees
 
-    for(auto& node: world.map.nodes){
-      updatenode(vertexpool, node);
+    {
+      stats::timer timer(stats::MESH);
+      for(auto& node: world.map.nodes){
+        updatenode(vertexpool, world.map, node);
+      }
     }
-    cout<<n++<<endl;
 
     //Update the Tree Particle System
 
-    treemodels.clear();
-    for(auto& t: Vegetation::plants){
-      glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(t.pos.x, t.size + quad::mapscale*world.map.get(t.pos)->get(t.pos)->height, t.pos.y));
-      model = glm::scale(model, glm::vec3(t.size));
-      treemodels.push_back(model);
+    {
+      stats::timer timer(stats::TREES);
+      const size_t n = Vegetation::plants.size();
+      treeheight.resize(n);
+
+      // Changed Plants (Birth, Death, Growth) and Terrain Heights
+
+      for(size_t w = 0; w < Vegetation::changed.size(); w++)
+      for(uint64_t m = Vegetation::changed[w]; m != 0; m &= m - 1)
+        treepool.mark(64*w + __builtin_ctzll(m));
+      Vegetation::changed.assign(Vegetation::changed.size(), 0);
+
+      for(size_t i = 0; i < n; i++){
+        const Plant& t = Vegetation::plants[i];
+        const float height = quad::mapscale*world.map.get(t.pos)->get(t.pos)->height;
+        if(height != treeheight[i]){
+          treeheight[i] = height;
+          treepool.mark(i);
+        }
+      }
+
+      treepool.update(n, [&](const size_t i){
+        const Plant& t = Vegetation::plants[i];
+        return TreeInstance{glm::vec3(t.pos.x, t.size + treeheight[i], t.pos.y), t.size};
+      });
     }
-    modelbuf.fill(treemodels);
-    treeparticle.SIZE = treemodels.size();    //  cout<<world.trees.size()<<endl;
 
 
     // Update Maps
 
-    dischargeMap.raw(image::make([&](const ivec2 p){
-      double d = World::map.discharge(p);
-  //    if(World::map.height(p) < 0.3)
-  //      d = 1.0;
-      return vec4(waterColor, d);
-    }, quad::res));
-
-    momentumMap.raw(image::make([&](const ivec2 p){
-      auto node = world.map.get(p);
-      auto cell = node->get(p);
-      float mx = cell->momentumx;
-      float my = cell->momentumy;
-      return glm::vec4(0.5f*(1.0f+erf(mx)), 0.5f*(1.0f+erf(my)), 0.5f, 1.0);
-    }, quad::res));
+    {
+      stats::timer timer(stats::UPLOAD);
+      dischargeMap.raw(image::make([&](const ivec2 p){
+        double d = World::map.discharge(p);
+    //    if(World::map.height(p) < 0.3)
+    //      d = 1.0;
+        return vec4(waterColor, d);
+      }, quad::res));
+
+      momentumMap.raw(image::make([&](const ivec2 p){
+        auto node = world.map.get(p);
+        auto cell = node->get(p);
+        float mx = cell->momentumx;
+        float my = cell->momentumy;
+        return glm::vec4(0.5f*(1.0f+erf(mx)), 0.5f*(1.0f+erf(my)), 0.5f, 1.0);
+      }, quad::res));
+    }
+
+    stats::frame();
 
   });
 
@@ -0,0 +1,299 @@
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+
+using namespace glm;
+using namespace std;
+
+#include "source/world.h"
+#include "source/mesh.h"
+
+/*
+SimpleHydrology - Bench
+
+Times the hot paths of the simulation and the per-frame
+mesh / map updates on a fixed seed and map size, and writes
+the results as JSON (bench.json, or the file given with -o).
+
+Every benchmark starts from a freshly generated map and runs
+the same sequence of operations, so the timings of two versions
+are comparable. A benchmark is repeated -r times, the time per
+operation is reported as minimum, median and mean.
+*/
+
+mappool::pool<quad::cell> cellpool;
+parallel::pool generators;      // Terrain Generation Workers, Kept over Resets
+
+void usage(){
+  std::cout<<"Usage: ./hydrology-bench [-s SEED] [-m MAPSIZE] [-r REPS] [-o FILE]"<<std::endl;
+}
+
+namespace bench {
+
+unsigned int SEED = 1;
+int reps = 5;
+
+struct result {
+  std::string name;
+  std::string unit;           // Operation which is Timed
+  size_t ops = 0;             // Operations per Repetition
+  std::vector<double> ns;     // Time per Operation, per Repetition
+};
+
+std::vector<result> results;
+volatile float keep = 0.0f;   // Sink for Results which are otherwise Unused
+
+// Regenerate the Map, so every Benchmark starts from the same State
+
+void reset(){
+  World::cycle = 0;
+  Vegetation::clear();
+  Vegetation::hazard = Hazard();
+  Vegetation::eligible = Eligible();
+  Vegetation::tick = 0;
+  cellpool.clear();
+  World::map.init(cellpool, generators, SEED);
+  World::tracks.release();
+  World::allocate();
+}
+
+// Time f() (which performs ops operations) reps Times,
+//  setup() is run before every repetition and not timed.
+
+template<typename S, typename F>
+void run(const std::string name, const std::string unit, S setup, F f){
+
+  result r;
+  r.name = name;
+  r.unit = unit;
+
+  for(int i = 0; i < reps; i++){
+
+    setup();
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t ops = f();
+    const auto stop = std::chrono::steady_clock::now();
+
+    r.ops = ops;
+    r.ns.push_back(std::chrono::duration<double, std::nano>(stop - start).count()/std::max<size_t>(ops, 1));
+
+  }
+
+  std::cerr<<name<<": "<<*std::min_element(r.ns.begin(), r.ns.end())<<" ns/"<<unit<<std::endl;
+  results.push_back(r);
+
+}
+
+bool write(std::ostream& out){
+
+  out<<"{\n";
+  out<<"  \"seed\": "<<SEED<<",\n";
+  out<<"  \"mapsize\": "<<quad::mapsize<<",\n";
+  out<<"  \"tilesize\": "<<quad::tilesize<<",\n";
+  out<<"  \"lodsize\": "<<quad::lodsize<<",\n";
+  out<<"  \"reps\": "<<reps<<",\n";
+  out<<"  \"benchmarks\": [\n";
+
+  for(size_t i = 0; i < results.size(); i++){
+
+    result& r = results[i];
+    std::vector<double> sorted = r.ns;
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0.0;
+    for(auto& t: sorted)
+      mean += t;
+    mean /= sorted.size();
+
+    out<<"    {\"name\": \""<<r.name<<"\", \"unit\": \""<<r.unit<<"\", \"ops\": "<<r.ops
+       <<", \"min_ns\": "<<sorted.front()<<", \"median_ns\": "<<sorted[sorted.size()/2]
+       <<", \"mean_ns\": "<<mean<<"}"<<((i + 1 < results.size()) ? "," : "")<<"\n";
+
+  }
+
+  out<<"  ]\n";
+  out<<"}\n";
+  return out.good();
+
+}
+
+// Vertex Sink without OpenGL (Vertexpool Interface used by updatenode)
+
+struct sink {
+
+  std::vector<float> vertices;
+
+  void fill(uint* index, const int k, const vec3 p, const vec3 n, const vec3 t, const vec3 b){
+    float* v = &vertices[12*k];
+    v[0] = p.x; v[1] = p.y; v[2] = p.z;
+    v[3] = n.x; v[4] = n.y; v[5] = n.z;
+    v[6] = t.x; v[7] = t.y; v[8] = t.z;
+    v[9] = b.x; v[10] = b.y; v[11] = b.z;
+  }
+
+};
+
+// Map Image Rebuild (as image::make: std::function per Pixel, RGBA8)
+
+size_t rebuild(std::vector<unsigned char>& img, std::function<vec4(ivec2)> f, const ivec2 res){
+
+  img.resize(4*res.x*res.y);
+  for(int x = 0; x < res.x; x++)
+  for(int y = 0; y < res.y; y++){
+    const vec4 c = f(ivec2(x, y));
+    unsigned char* p = &img[4*(y*res.x + x)];
+    p[0] = (unsigned char)(255*c.x);
+    p[1] = (unsigned char)(255*c.y);
+    p[2] = (unsigned char)(255*c.z);
+    p[3] = (unsigned char)(255*c.w);
+  }
+
+  return res.x*res.y;
+
+}
+
+// Plants at Random Positions (Fixed Sequence)
+
+void plant(const size_t n){
+
+  Vegetation::clear();
+  rng::counter r(SEED, rng::VEGETATION, 0, 0xBE);
+
+  while(Vegetation::plants.size() < n){
+    const vec2 pos = vec2(r(quad::res.x), r(quad::res.y));
+    Vegetation::add(pos, Plant::lifetime(r));
+    Vegetation::plants.back().size = Plant::maxSize*r.uniform();
+  }
+
+}
+
+}; // namespace bench
+
+int main( int argc, char* args[] ) {
+
+  std::string path = "bench.json";
+
+  for(int i = 1; i < argc; i++){
+    const std::string arg = args[i];
+    if(i + 1 >= argc){
+      usage();
+      return 1;
+    }
+    else if(arg == "-s") bench::SEED = std::stoi(args[++i]);
+    else if(arg == "-m") quad::resize(std::stoi(args[++i]));
+    else if(arg == "-r") bench::reps = std::stoi(args[++i]);
+    else if(arg == "-o") path = args[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  World::SEED = bench::SEED;
+  srand(World::SEED);
+  cellpool.reserve(quad::area);
+  generators.init(std::thread::hardware_concurrency());
+
+  // Fixed Drop Spawn Positions
+
+  std::vector<vec2> spawns;
+  {
+    rng::counter r(bench::SEED, rng::EROSION, 0, 0xBE);
+    while(spawns.size() < 4096)
+      spawns.push_back(vec2(r(quad::res.x), r(quad::res.y)));
+  }
+
+  // Erosion Kernels
+
+  bench::run("descend", "step", bench::reset, [&](){
+    size_t steps = 0;
+    for(auto& p: spawns){
+      Drop drop(p);
+      while(drop.descend<param::runtime>())
+        steps++;
+    }
+    return steps;
+  });
+
+  bench::run("cascade", "call", bench::reset, [&](){
+    size_t n = 0;
+    for(int k = 0; k < 64; k++)
+    for(auto& p: spawns){
+      World::cascade<param::runtime>(p);
+      n++;
+    }
+    return n;
+  });
+
+  bench::run("normal", "cell", bench::reset, [&](){
+    vec3 sum = vec3(0);
+    for(auto& node: World::map.nodes)
+    for(auto [cell, pos]: node.s)
+      sum += quad::_normal(World::map, node.pos + quad::lodsize*pos);
+    bench::keep = sum.x;
+    return (size_t)quad::area/quad::lodarea;
+  });
+
+  bench::run("erode", "cycle", bench::reset, [&](){
+    World::erode(quad::tilesize);
+    return (size_t)1;
+  });
+
+  // Vegetation
+
+  for(const size_t n: {10000, 100000}){
+    bench::run("grow_" + std::to_string(n/1000) + "k", "plant", [&](){
+      bench::reset();
+      bench::plant(n);
+    }, [&](){
+      Vegetation::grow();
+      return n;
+    });
+  }
+
+  // Per-Frame Mesh / Map Updates
+
+  bench::sink sink;
+  sink.vertices.resize(12*quad::tilearea/quad::lodarea);
+
+  bench::run("updatenode", "cell", bench::reset, [&](){
+    for(auto& node: World::map.nodes)
+      quad::updatenode(sink, World::map, node);
+    return (size_t)quad::area/quad::lodarea;
+  });
+
+  std::vector<unsigned char> img;
+  const vec3 waterColor = vec3(0.2, 0.3, 0.6);
+
+  bench::run("mapimages", "pixel", bench::reset, [&](){
+    size_t n = 0;
+    n += bench::rebuild(img, [&](const ivec2 p){
+      return vec4(waterColor, World::map.discharge(p));
+    }, quad::res);
+    n += bench::rebuild(img, [&](const ivec2 p){
+      auto cell = World::map.get(p)->get(p);
+      return vec4(0.5f*(1.0f+erf(cell->momentumx)), 0.5f*(1.0f+erf(cell->momentumy)), 0.5f, 1.0);
+    }, quad::res);
+    return n;
+  });
+
+  // Write Results
+
+  std::ofstream out(path);
+  if(!out.is_open()){
+    std::cout<<"Failed to open "<<path<<std::endl;
+    return 1;
+  }
+
+  return bench::write(out) ? 0 : 1;
+
+}
@@ -0,0 +1,184 @@
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+using namespace glm;
+using namespace std;
+
+#include "source/world.h"
+#include "source/export.h"
+#include "source/checkpoint.h"
+#include "source/multigrid.h"
+
+/*
+SimpleHydrology - Headless
+
+Runs the erosion and vegetation system
+without any rendering, then exports the
+resulting fields to disk.
+*/
+
+mappool::pool<quad::cell> cellpool;
+
+void usage(){
+  std::cout<<"Usage: ./hydrology-headless [-s SEED] [-m MAPSIZE] [-d CACHEDIR] [-g LEVELS] [-n CYCLES] [-t THREADS] [-e PRESET] [-v MAXPLANTS] [-l] [-w] [-p PAGEFILE] [-b BUDGET_MB] [-c CHECKPOINT] [-k INTERVAL] [-r CHECKPOINT] [-i STATS] [-o PREFIX]"<<std::endl;
+}
+
+int main( int argc, char* args[] ) {
+
+  // Parse Arguments
+
+  World::SEED = time(NULL);
+  int cycles = 500;
+  std::string prefix = "out_";
+  std::string pagefile = "";
+  size_t budget = 0;
+  std::string save = "";
+  std::string restore = "";
+  int interval = 0;
+  int levels = 0;
+  std::string statsfile = "";
+
+  for(int i = 1; i < argc; i++){
+    const std::string arg = args[i];
+    if(arg == "-l") World::localtracks = true;
+    else if(arg == "-w") World::wavefront = true;
+    else if(i + 1 >= argc){
+      usage();
+      return 1;
+    }
+    else if(arg == "-s") World::SEED = std::stoi(args[++i]);
+    else if(arg == "-m") quad::resize(std::stoi(args[++i]));
+    else if(arg == "-d") quad::terrain::cache = args[++i];
+    else if(arg == "-g") levels = std::stoi(args[++i]);
+    else if(arg == "-n") cycles = std::stoi(args[++i]);
+    else if(arg == "-t") World::threads = std::stoi(args[++i]);
+    else if(arg == "-e"){
+      if(!param::parse(args[++i], param::active)){
+        usage();
+        return 1;
+      }
+    }
+    else if(arg == "-v") Vegetation::plants.capacity = std::stoul(args[++i]);
+    else if(arg == "-p") pagefile = args[++i];
+    else if(arg == "-b") budget = std::stoul(args[++i]);
+    else if(arg == "-c") save = args[++i];
+    else if(arg == "-k") interval = std::stoi(args[++i]);
+    else if(arg == "-r") restore = args[++i];
+    else if(arg == "-i") statsfile = args[++i];
+    else if(arg == "-o") prefix = args[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if(levels < 0 || levels > multigrid::maxlevels()){
+    std::cout<<"Multigrid Levels (-g) must be in [0, "<<multigrid::maxlevels()<<"]"<<std::endl;
+    return 1;
+  }
+
+  srand(World::SEED);
+
+  // Initialize the World
+
+  checkpoint::chain chain(save);
+
+  if(!restore.empty()){
+    if(restore == save){
+      if(!chain.load(cellpool))
+        return 1;
+    }
+    else if(!checkpoint::chain(restore).load(cellpool))
+      return 1;
+  }
+
+  else if(pagefile.empty())
+    cellpool.reserve(quad::area);
+
+  else {
+
+    // Page Nodes to a File within the Memory Budget
+
+    const size_t nodebytes = (quad::tilearea/quad::lodarea)*(sizeof(quad::cell) + sizeof(vec4));
+    World::map.budget = (budget > 0) ? (budget << 20)/nodebytes : quad::maparea;
+    if(World::map.budget < 4)
+      World::map.budget = 4;
+
+    if(!cellpool.reserve(quad::area, pagefile)){
+      std::cout<<"Failed to map page file "<<pagefile<<std::endl;
+      return 1;
+    }
+
+  }
+
+  // Terrain Generation Workers (Shared by the Multigrid Levels)
+
+  parallel::pool generators;
+  if(restore.empty())
+    generators.init(std::thread::hardware_concurrency());
+
+  if(restore.empty() && levels > 0){
+
+    // Coarse-to-Fine Erosion
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t drops = multigrid::run(cellpool, generators, levels, World::SEED);
+    const auto stop = std::chrono::steady_clock::now();
+    std::cout<<"Multigrid: "<<drops<<" drops in "<<std::chrono::duration<double>(stop - start).count()<<"s"<<std::endl;
+
+  }
+
+  else if(restore.empty())
+    World::map.init(cellpool, generators, World::SEED);
+
+  generators.clear();
+
+  if(!statsfile.empty() && !stats::open(statsfile)){
+    std::cout<<"Failed to open "<<statsfile<<std::endl;
+    return 1;
+  }
+
+  // Run the Simulation
+
+  std::cout<<"Running "<<cycles<<" Cycles"<<std::endl;
+
+  const auto start = std::chrono::steady_clock::now();
+  size_t drops = 0;
+
+  for(int n = 0; n < cycles; n++){
+
+    drops += World::erode(quad::tilesize); //Execute Erosion Cycles
+    Vegetation::grow();           //Grow Trees
+    stats::frame();
+
+    if((n+1)%50 == 0)
+      std::cout<<"... cycle "<<(n+1)<<" ..."<<std::endl;
+
+    if(!save.empty() && interval > 0 && (n+1)%interval == 0)
+      chain.save(cellpool);
+
+  }
+
+  const auto stop = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(stop - start).count();
+
+  std::cout<<"Finished in "<<seconds<<"s ("<<cycles/seconds<<" cycles/s, "<<drops/seconds<<" drops/s)"<<std::endl;
+  std::cout<<"Plants: "<<Vegetation::plants.size()<<std::endl;
+
+  if(!save.empty() && !chain.save(cellpool))
+    return 1;
+
+  // Export the Fields
+
+  if(!field::save(prefix, World::map))
+    return 1;
+
+  return 0;
+
+}
@@ -0,0 +1,281 @@
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace glm;
+using namespace std;
+
+#include "source/world.h"
+#include "source/export.h"
+
+/*
+SimpleHydrology - Sweep
+
+Runs a parameter sweep on a single initial terrain. The terrain
+is generated once, then every configuration is run in a forked
+worker process, which shares the generated cells copy-on-write.
+Up to JOBS workers run at the same time.
+
+Every line of the configuration file is one run, given as a list
+of name=value pairs of the runtime parameters (see param::registry).
+"seed=N" changes the erosion and vegetation seed, not the terrain.
+Empty lines and lines starting with # are skipped.
+
+Every run writes its fields (PREFIX<run>_height.pgm, ...), and a
+summary of all runs is written to PREFIXsweep.csv.
+*/
+
+mappool::pool<quad::cell> cellpool;
+
+void usage(){
+  std::cout<<"Usage: ./hydrology-sweep [-s SEED] [-m MAPSIZE] [-d CACHEDIR] [-n CYCLES] [-j JOBS] [-o PREFIX] CONFIG"<<std::endl;
+}
+
+// Apply a Configuration Line to the Runtime Parameters
+
+bool configure(const std::string& line){
+
+  std::istringstream in(line);
+  std::string pair;
+
+  while(in >> pair){
+
+    const size_t eq = pair.find('=');
+    if(eq == std::string::npos){
+      std::cout<<"Invalid Parameter "<<pair<<std::endl;
+      return false;
+    }
+
+    const std::string name = pair.substr(0, eq);
+    const std::string value = pair.substr(eq + 1);
+
+    if(name == "seed"){
+      World::SEED = std::stoul(value);
+      continue;
+    }
+
+    float* p = param::find(name);
+    if(p == NULL){
+      std::cout<<"Unknown Parameter "<<name<<std::endl;
+      return false;
+    }
+
+    *p = std::stof(value);
+
+  }
+
+  return true;
+
+}
+
+// Run a Configuration (in the Worker), Returns the Summary Metrics
+
+std::string run(const std::string& config, const std::string& prefix, const int cycles, const double initial){
+
+  if(!configure(config))
+    return "";
+
+  const auto start = std::chrono::steady_clock::now();
+  size_t drops = 0;
+
+  for(int n = 0; n < cycles; n++){
+    drops += World::erode(quad::tilesize);
+    Vegetation::grow();
+  }
+
+  const auto stop = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(stop - start).count();
+
+  // Summary Metrics
+
+  double height = 0.0, discharge = 0.0;
+  size_t rivers = 0;
+
+  for(auto& node: World::map.nodes)
+  for(auto [cell, pos]: node.s){
+    height += cell.height;
+    discharge += erf(0.4f*cell.discharge);
+    if(erf(0.4f*cell.discharge) >= Plant::maxDischarge)
+      rivers++;
+  }
+
+  const size_t cells = quad::area/quad::lodarea;
+  height /= cells;
+  discharge /= cells;
+
+  if(!field::save(prefix, World::map))
+    return "";
+
+  std::ostringstream out;
+  out<<drops<<","<<seconds<<","<<Vegetation::plants.size()<<","
+     <<height<<","<<(height - initial)<<","<<discharge<<","<<(double)rivers/cells;
+  return out.str();
+
+}
+
+int main( int argc, char* args[] ) {
+
+  // Parse Arguments
+
+  World::SEED = time(NULL);
+  int cycles = 500;
+  int jobs = std::thread::hardware_concurrency();
+  std::string prefix = "sweep_";
+  std::string path = "";
+
+  for(int i = 1; i < argc; i++){
+    const std::string arg = args[i];
+    if(i + 1 >= argc){
+      if(arg[0] == '-' || !path.empty()){
+        usage();
+        return 1;
+      }
+      path = arg;
+    }
+    else if(arg == "-s") World::SEED = std::stoi(args[++i]);
+    else if(arg == "-m") quad::resize(std::stoi(args[++i]));
+    else if(arg == "-d") quad::terrain::cache = args[++i];
+    else if(arg == "-n") cycles = std::stoi(args[++i]);
+    else if(arg == "-j") jobs = std::stoi(args[++i]);
+    else if(arg == "-o") prefix = args[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if(path.empty() || jobs < 1){
+    usage();
+    return 1;
+  }
+
+  // Load the Configurations
+
+  std::ifstream in(path);
+  if(!in.is_open()){
+    std::cout<<"Failed to open "<<path<<std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> configs;
+  std::string line;
+  while(std::getline(in, line)){
+    if(line.find_first_not_of(" \t") == std::string::npos || line[line.find_first_not_of(" \t")] == '#')
+      continue;
+    configs.push_back(line);
+  }
+
+  // Generate the Shared Terrain
+
+  srand(World::SEED);
+  cellpool.reserve(quad::area);
+
+  {
+    // Workers are Joined before Forking
+    parallel::pool generators(std::thread::hardware_concurrency());
+    World::map.init(cellpool, generators, World::SEED);
+  }
+
+  double initial = 0.0;
+  for(auto& node: World::map.nodes)
+  for(auto [cell, pos]: node.s)
+    initial += cell.height;
+  initial /= quad::area/quad::lodarea;
+
+  std::cout<<"Running "<<configs.size()<<" Configurations ("<<cycles<<" Cycles, "<<jobs<<" Jobs)"<<std::endl;
+
+  // Fork the Workers: The Result is sent back over a Pipe
+
+  struct worker {
+    size_t run;
+    int fd;
+  };
+
+  std::map<pid_t, worker> running;
+  std::vector<std::string> results(configs.size());
+  size_t next = 0;
+  bool ok = true;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  while(next < configs.size() || !running.empty()){
+
+    while(next < configs.size() && running.size() < (size_t)jobs){
+
+      int fd[2];
+      if(pipe(fd) != 0){
+        std::cout<<"Failed to create pipe"<<std::endl;
+        return 1;
+      }
+
+      const pid_t pid = fork();
+
+      if(pid == 0){
+        close(fd[0]);
+        const std::string result = run(configs[next], prefix + std::to_string(next) + "_", cycles, initial);
+        const bool written = write(fd[1], result.data(), result.size()) == (ssize_t)result.size();
+        close(fd[1]);
+        _exit((!result.empty() && written) ? 0 : 1);
+      }
+
+      close(fd[1]);
+
+      if(pid < 0){
+        close(fd[0]);
+        std::cout<<"Failed to fork"<<std::endl;
+        return 1;
+      }
+
+      running[pid] = {next++, fd[0]};
+
+    }
+
+    int status = 0;
+    const pid_t pid = wait(&status);
+    if(pid < 0 || running.count(pid) == 0)
+      continue;
+
+    const worker w = running[pid];
+    running.erase(pid);
+
+    char buf[256];
+    ssize_t n;
+    while((n = read(w.fd, buf, sizeof(buf))) > 0)
+      results[w.run].append(buf, n);
+    close(w.fd);
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || results[w.run].empty()){
+      std::cout<<"Run "<<w.run<<" failed: "<<configs[w.run]<<std::endl;
+      ok = false;
+    }
+    else std::cout<<"... run "<<w.run<<" done ..."<<std::endl;
+
+  }
+
+  const auto stop = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(stop - start).count();
+  std::cout<<"Finished in "<<seconds<<"s ("<<configs.size()/seconds<<" runs/s)"<<std::endl;
+
+  // Write the Summary
+
+  std::ofstream out(prefix + "sweep.csv");
+  out<<"run,config,drops,seconds,plants,height,dheight,discharge,rivers\n";
+  for(size_t i = 0; i < configs.size(); i++)
+  if(!results[i].empty())
+    out<<i<<",\""<<configs[i]<<"\","<<results[i]<<"\n";
+
+  return (ok && out.good()) ? 0 : 1;
+
+}
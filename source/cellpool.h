@@ -1,6 +1,17 @@
 #ifndef SIMPLEHYDROLOGY_CELLPOOL
 #define SIMPLEHYDROLOGY_CELLPOOL
 
+#include <array>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 /*
 ================================================================================
                     Interleaved Cell Data Memory Pool
@@ -8,18 +19,56 @@
   Individual cell properties are stored in an interleaved data format.
   The mappool acts as a fixed-size memory pool for these cells.
   This acts as the base for creating sliceable, indexable, iterable map regions.
+
+  The layout trait defines how a pool's data is allocated and addressed.
+  Compiling with HYDROLOGY_SOA splits the cells into separate planes.
+
+  A pool can also be placed in a memory mapping, backed by a file, so
+  that sections of it can be written back and released (see evict).
 */
 
 namespace mappool {
 
+const size_t pagesize = 4096;
+
+// Storage Layout of a Pool's Data (Default: Interleaved)
+template<typename T> struct layout {
+  typedef T* ptr;       // Pointer to an Element
+  typedef T& ref;       // Reference to an Element
+
+  static ptr alloc(const size_t size){
+    return new T[size];
+  }
+
+  static void free(ptr p){
+    delete[] p;
+  }
+
+  // Mapped Storage: Size, Placement and Contiguous Planes of a Section
+
+  static size_t bytes(const size_t size){
+    return sizeof(T)*size;
+  }
+
+  static ptr place(char* mem, const size_t size){
+    return (T*)mem;
+  }
+
+  template<typename F>
+  static void planes(const ptr p, const size_t size, F f){
+    f((char*)p, sizeof(T)*size);
+  }
+};
+
 // Raw Interleaved Data Buffer
 template<typename T> struct buf;
 template<typename T> struct buf_iterator {
-  T* cur = NULL;
+  typedef typename layout<T>::ptr ptr;
+  ptr cur = NULL;
   buf_iterator() noexcept : cur(NULL){};
-  buf_iterator(T* t) noexcept : cur(t){};
+  buf_iterator(ptr t) noexcept : cur(t){};
 
-  const T operator*() noexcept {
+  typename layout<T>::ref operator*() noexcept {
       return *this->cur;
   };
 
@@ -33,7 +82,7 @@ template<typename T> struct buf_iterator {
   };
 };
 template<typename T> struct buf {
-  T* start = NULL;
+  typename layout<T>::ptr start = NULL;
   size_t size = 0;
 
   const buf_iterator<T> begin() const noexcept { return buf_iterator<T>(start); }
@@ -43,13 +92,14 @@ template<typename T> struct buf {
 // Raw Interleaved Data Buffer Slice
 template<typename T> struct slice;
 template<typename T> struct sliceval {
-  T& start;             // Variable Reference
-  ivec2 pos = ivec2(0); // Slice Position
+  typename layout<T>::ref start;  // Variable Reference
+  ivec2 pos = ivec2(0);           // Slice Position
 };
 template<typename T> struct slice_iterator {
   ivec2 pos = ivec2(0);
-  buf_iterator<T> cur = NULL;
+  buf_iterator<T> cur;
   const ivec2 res;
+  int index = 0;
 
   slice_iterator() noexcept : cur(NULL){};
   slice_iterator(const buf_iterator<T>& t, const ivec2 r) noexcept : cur(t), res(r){};
@@ -60,9 +110,13 @@ template<typename T> struct slice_iterator {
 
   const slice_iterator<T>& operator++() noexcept {
     ++cur;
+    #if defined(HYDROLOGY_MORTON) || defined(HYDROLOGY_BLOCKED)
+    pos = math::cunflatten(++index, res);
+    #else
     if((pos.y + 1)%res.x == 0)
       pos.x = (pos.x + 1);
     pos.y = (pos.y + 1)%res.x;
+    #endif
     return *this;
   };
 
@@ -72,6 +126,8 @@ template<typename T> struct slice_iterator {
 };
 template<typename T> struct slice {
 
+  typedef typename layout<T>::ptr ptr;
+
   mappool::buf<T> root;
   ivec2 res = ivec2(0);
 
@@ -87,10 +143,14 @@ template<typename T> struct slice {
     return false;
   }
 
-  inline T* get(const ivec2 p){
+  inline ptr get(const ivec2 p){
     if(root.start == NULL) return NULL;
     if(oob(p)) return NULL;
-    return root.start + math::flatten(p, res);
+    return root.start + math::cflatten(p, res);
+  }
+
+  inline ptr at(const size_t i){
+    return root.start + i;
   }
 
   slice_iterator<T> begin() const noexcept { return slice_iterator<T>(root.begin(), res); }
@@ -110,17 +170,117 @@ struct pool {
     reserve(_size);
   }
 
+  int fd = -1;            // Backing File
+  char* mem = NULL;       // Memory Mapping (NULL: Heap)
+  size_t bytes = 0;
+  bool cow = false;       // Private File Mapping (Copy-On-Write)
+
   ~pool(){
+    release();
+  }
+
+  void release(){
+    if(mem != NULL){
+      munmap(mem, bytes);
+      if(fd >= 0) close(fd);
+      mem = NULL;
+      root.start = NULL;
+    }
     if(root.start != NULL){
-      delete[] root.start;
+      layout<T>::free(root.start);
       root.start = NULL;
     }
+    root.size = 0;
+    free.clear();
+    fd = -1;
+    bytes = 0;
+    cow = false;
   }
 
   void reserve(size_t _size){
     root.size = _size;
-    root.start = new T[root.size];
+    root.start = layout<T>::alloc(root.size);
+    free.emplace_front(root.start, root.size);
+  }
+
+  // Reserve in a Shared File Mapping, or an Anonymous Mapping if path is empty
+
+  bool reserve(size_t _size, const std::string& path){
+
+    bytes = (layout<T>::bytes(_size) + pagesize - 1)/pagesize*pagesize;
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if(!path.empty()){
+      fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if(fd < 0 || ftruncate(fd, bytes) != 0)
+        return false;
+      flags = MAP_SHARED;
+    }
+
+    void* m = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if(m == MAP_FAILED)
+      return false;
+
+    mem = (char*)m;
+    root.size = _size;
+    root.start = layout<T>::place(mem, root.size);
+    free.emplace_front(root.start, root.size);
+    return true;
+
+  }
+
+  // Reserve in a Private Mapping of an existing File at a Page-Aligned
+  //  Offset. Changes are not written back to the file.
+
+  bool load(size_t _size, const std::string& path, const size_t offset){
+
+    bytes = (layout<T>::bytes(_size) + pagesize - 1)/pagesize*pagesize;
+
+    const int f = ::open(path.c_str(), O_RDONLY);
+    if(f < 0)
+      return false;
+
+    void* m = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, f, offset);
+    close(f);
+    if(m == MAP_FAILED)
+      return false;
+
+    mem = (char*)m;
+    cow = true;
+    root.size = _size;
+    root.start = layout<T>::place(mem, root.size);
     free.emplace_front(root.start, root.size);
+    return true;
+
+  }
+
+  // Write Back and Release the Whole Pages of a Section (Mapped Pools).
+  //  Anonymous pages are released as zeros, private file pages are kept.
+
+  void evict(const buf<T>& b){
+
+    if(mem == NULL || cow)
+      return;
+
+    layout<T>::planes(b.start, b.size, [&](char* data, const size_t len){
+      const size_t off = data - mem;
+      const size_t first = (off + pagesize - 1)/pagesize*pagesize;
+      const size_t last = (off + len)/pagesize*pagesize;
+      if(last <= first)
+        return;
+      if(fd >= 0) msync(mem + first, last - first, MS_SYNC);
+      madvise(mem + first, last - first, MADV_DONTNEED);
+      if(fd >= 0) posix_fadvise(fd, first, last - first, POSIX_FADV_DONTNEED);
+    });
+
+  }
+
+  // Return all Sections to the Pool (Data is kept)
+
+  void clear(){
+    free.clear();
+    if(root.start != NULL)
+      free.emplace_front(root.start, root.size);
   }
 
   buf<T> get(size_t _size){
@@ -168,15 +328,34 @@ const int tilesize = 512;
 const int tilearea = tilesize*tilesize;
 const ivec2 tileres = ivec2(tilesize);
 
-const int mapsize = 1;
-const int maparea = mapsize*mapsize;
+// Level of Detail: Cells are lodsize x lodsize World Units (Power of Two)
+
+int lodshift = 0;
+int lodsize = 1;
+int lodarea = 1;
+
+void setlod(const int shift){
+  lodshift = shift;
+  lodsize = 1 << shift;
+  lodarea = lodsize*lodsize;
+}
+
+// Map Dimensions in Tiles (Set at Startup, before map::init)
 
-const int size = mapsize*tilesize;
-const int area = maparea*tilearea;
-const ivec2 res = ivec2(size);
+int mapsize = 1;
+int maparea = 1;
 
-const int lodsize = 1;
-const int lodarea = lodsize*lodsize;
+int size = tilesize;
+int area = tilearea;
+ivec2 res = ivec2(tilesize);
+
+void resize(const int _mapsize){
+  mapsize = _mapsize;
+  maparea = mapsize*mapsize;
+  size = mapsize*tilesize;
+  area = maparea*tilearea;
+  res = ivec2(size);
+}
 
 template<typename T>
 vec3 _normal(T& t, ivec2 p){
@@ -203,7 +382,8 @@ vec3 _normal(T& t, ivec2 p){
 
 }
 
-// Raw Interleaved Cell Data
+// Raw Interleaved Cell Data (The Discharge / Momentum Tracks of a Cycle
+//  are Transient, and kept outside of the Cells: see World::tracks)
 struct cell {
 
   float height;
@@ -211,30 +391,177 @@ struct cell {
   float momentumx;
   float momentumy;
 
-  float discharge_track;
-  float momentumx_track;
-  float momentumy_track;
+  float rootdensity;
+
+};
+
+#ifndef HYDROLOGY_SOA
+
+typedef cell* cellptr;
+typedef cell& cellref;
+
+#else
+
+/*
+  Hot / Cold Split Cell Data:
+
+  The cell properties are split into separate planes by access pattern,
+  so that a height lookup doesn't pull the other properties into cache.
+  A cellptr points into all planes at once and is used like a cell*.
+*/
+
+struct cell_height {
+  float height;
+};
+
+struct cell_flow {
+  float discharge;
+  float momentumx;
+  float momentumy;
+};
 
+struct cell_root {
   float rootdensity;
+};
+
+struct cellref {
+
+  float& height;
+  float& discharge;
+  float& momentumx;
+  float& momentumy;
+
+  float& rootdensity;
+
+};
+
+struct cellptr {
+
+  cell_height* h = NULL;
+  cell_flow* f = NULL;
+  cell_root* r = NULL;
+
+  cellptr(){}
+  cellptr(std::nullptr_t){}
+  cellptr(cell_height* _h, cell_flow* _f, cell_root* _r):h(_h),f(_f),r(_r){}
+
+  // Member Access through a Temporary Reference
+
+  struct arrow {
+    cellref ref;
+    cellref* operator->() noexcept { return &ref; }
+  };
+
+  inline cellref operator*() const noexcept {
+    return { h->height, f->discharge, f->momentumx, f->momentumy, r->rootdensity };
+  }
+
+  inline arrow operator->() const noexcept {
+    return { **this };
+  }
+
+  // Pointer Arithmetic
+
+  inline cellptr operator+(const size_t i) const noexcept {
+    return { h + i, f + i, r + i };
+  }
+
+  inline cellptr& operator+=(const size_t i) noexcept {
+    h += i; f += i; r += i;
+    return *this;
+  }
+
+  inline cellptr& operator++() noexcept {
+    ++h; ++f; ++r;
+    return *this;
+  }
+
+  inline ptrdiff_t operator-(const cellptr& other) const noexcept {
+    return h - other.h;
+  }
+
+  inline bool operator==(const cellptr& other) const noexcept { return h == other.h; }
+  inline bool operator!=(const cellptr& other) const noexcept { return h != other.h; }
+
+};
+
+#endif
+
+}; // namespace quad
+
+#ifdef HYDROLOGY_SOA
+
+namespace mappool {
+
+// Split Planes are Allocated Separately
 
+template<> struct layout<quad::cell> {
+  typedef quad::cellptr ptr;
+  typedef quad::cellref ref;
+
+  static ptr alloc(const size_t size){
+    return { new quad::cell_height[size], new quad::cell_flow[size], new quad::cell_root[size] };
+  }
+
+  static void free(ptr p){
+    delete[] p.h;
+    delete[] p.f;
+    delete[] p.r;
+  }
+
+  // Mapped Planes are Page-Aligned, one after the other
+
+  static size_t plane(const size_t bytes){
+    return (bytes + pagesize - 1)/pagesize*pagesize;
+  }
+
+  static size_t bytes(const size_t size){
+    return plane(sizeof(quad::cell_height)*size) + plane(sizeof(quad::cell_flow)*size)
+      + plane(sizeof(quad::cell_root)*size);
+  }
+
+  static ptr place(char* mem, const size_t size){
+    ptr p;
+    p.h = (quad::cell_height*)mem;  mem += plane(sizeof(quad::cell_height)*size);
+    p.f = (quad::cell_flow*)mem;    mem += plane(sizeof(quad::cell_flow)*size);
+    p.r = (quad::cell_root*)mem;
+    return p;
+  }
+
+  template<typename F>
+  static void planes(const ptr p, const size_t size, F f){
+    f((char*)p.h, sizeof(quad::cell_height)*size);
+    f((char*)p.f, sizeof(quad::cell_flow)*size);
+    f((char*)p.r, sizeof(quad::cell_root)*size);
+  }
 };
 
+}; // namespace mappool
+
+#endif
+
+namespace quad {
+
 struct node {
 
   ivec2 pos = ivec2(0);   // Absolute World Position
   uint* vertex = NULL;    // Vertexpool Rendering Pointer
   mappool::slice<cell> s; // Raw Interleaved Data Slices
+  mappool::slice<vec4> n; // Cached Normals (w = 0: Invalid)
 
-  inline cell* get(const ivec2 p){
-    return s.get((p - pos)/lodsize);
+  uint32_t stamp = 0;     // Paging Epoch of Last Access
+  bool resident = true;   // Not Evicted since Last Access
+
+  inline cellptr get(const ivec2 p){
+    return s.get((p - pos) >> lodshift);
   }
 
   const inline bool oob(const ivec2 p){
-    return s.oob((p - pos)/lodsize);
+    return s.oob((p - pos) >> lodshift);
   }
 
   const inline float height(ivec2 p){
-    cell* c = get(p);
+    cellptr c = get(p);
     if(c == NULL) return 0.0f;
     return c->height;
   }
@@ -249,81 +576,108 @@ struct node {
 
 };
 
-void indexnode(Vertexpool<Vertex>& vertexpool, quad::node& t){
-
-  // Iterate over the Node's Slice
-  for(const auto& [cell, pos]: t.s){
-    if(pos.x == tilesize/lodsize - 1) continue;
-    if(pos.y == tilesize/lodsize - 1) continue;
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(0, 0), tileres/lodsize));
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(0, 1), tileres/lodsize));
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(1, 0), tileres/lodsize));
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(1, 0), tileres/lodsize));
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(0, 1), tileres/lodsize));
-    vertexpool.indices.push_back(math::flatten(pos + ivec2(1, 1), tileres/lodsize));
-  }
+/*
+================================================================================
+                        Generated Terrain Cache
+================================================================================
+  The generated (normalized) heights only depend on the generator inputs
+  below. If a cache directory is set, they are stored in a file named by a
+  hash of these inputs, and the next init with the same inputs maps this
+  file instead of generating the noise again.
 
-  // Side-Drapes
+  Heights are stored per node in the order of the slice, so the cell order
+  (Morton / blocked) is part of the key.
+*/
 
-  /*
-  for(size_t i = 0; i < tilesize/lodsize - 1; i++){
-    vertexpool.indices.push_back(i);
-    vertexpool.indices.push_back(tilesize + i);
-    vertexpool.indices.push_back(tilesize + i + 1);
-    vertexpool.indices.push_back(i+1);
-    vertexpool.indices.push_back(tilesize + i + 1);
-    vertexpool.indices.push_back(tilesize + i);
-  }
-  */
+// Terrain Generator Parameters
 
-  // Update the Vertexpool Properties
-  vertexpool.resize(t.vertex, vertexpool.indices.size());
-  vertexpool.index();
-  vertexpool.update();
+const int octaves = 8;
+const float frequency = 1.0f;     // Frequency of the First Octave (per Tile)
+const float amplitude = 0.6f;     // Amplitude of the First Octave
+const double gain = 0.6;          // Amplitude Factor per Octave
 
-}
+namespace terrain {
 
-void updatenode(Vertexpool<Vertex>& vertexpool, quad::node& t){
+std::string cache = "";           // Cache Directory (Empty: Disabled)
+const uint32_t version = 1;       // Generator Version (Change when it Changes)
 
-  for(auto [cell, pos]: t.s){
+struct header {
+  char magic[8] = {'H', 'Y', 'D', 'R', 'O', 'T', 'E', 'R'};
+  uint64_t key = 0;
+  uint64_t cells = 0;
+};
 
-    glm::vec2 p = t.pos + lodsize*pos;
-    glm::vec2 pT = t.pos + lodsize*(pos + ivec2( 1, 0));
-    glm::vec2 pB = t.pos + lodsize*(pos + ivec2( 0, 1));
+inline uint64_t bits(const double v){
+  uint64_t b;
+  std::memcpy(&b, &v, sizeof(b));
+  return b;
+}
 
-    glm::vec3 P = glm::vec3(p.x, quad::mapscale*t.height(p), p.y);
-    glm::vec3 T = glm::vec3(pT.x, quad::mapscale*t.height(pT), pT.y);
-    glm::vec3 B = glm::vec3(pB.x, quad::mapscale*t.height(pB), pB.y);
+uint64_t key(const unsigned int SEED){
 
-    vertexpool.fill(t.vertex, math::flatten(pos, tileres/lodsize),
-      P,
-      t.normal(p),
-      T - P,
-      B - P
-    );
+  uint64_t k = rng::splitmix(version);
+  auto mix = [&](const uint64_t v){
+    k = rng::splitmix(k ^ v);
+  };
 
-  }
+  mix(SEED);
+  mix(mapsize);
+  mix(tilesize);
+  mix(lodshift);
+  mix(octaves);
+  mix(bits(frequency));
+  mix(bits(amplitude));
+  mix(bits(gain));
+  mix(FastNoiseLite::NoiseType_OpenSimplex2);
+  mix(FastNoiseLite::FractalType_FBm);
+
+  #if defined(HYDROLOGY_MORTON)
+  mix(1);
+  #elif defined(HYDROLOGY_BLOCKED)
+  mix(2);
+  #endif
+
+  return k;
 
-  /*
-  for(size_t i = 0; i < tilesize/lodsize; i++){
-    vertexpool.fill(t.vertex, tilesize + i,
-      glm::vec3(0, -10, i),
-      glm::vec3(1, 0, 0),
-      glm::vec3(0, 1, 0),
-      glm::vec3(0, 0, 1)
-    );
-  }*/
+}
 
+std::string path(const uint64_t key){
+  char name[32];
+  std::snprintf(name, sizeof(name), "terrain-%016lx.bin", (unsigned long)key);
+  return cache + "/" + name;
 }
 
+}; // namespace terrain
+
 struct map {
 
-  node nodes[maparea];
+  std::vector<node> nodes;
+  mappool::pool<vec4> normalpool;
+  mappool::pool<cell>* cellpool = NULL;
+
+  size_t budget = 0;      // Maximum Resident Nodes (0: No Paging)
+  uint32_t epoch = 1;     // Paging Epoch
+
+  std::vector<uint64_t> dirty;  // Written Cells (Bitmap, Indexed as the Cellpool)
+
+  // Assign the Nodes their Sections of the Pools
 
-  void init(Vertexpool<Vertex>& vertexpool, mappool::pool<cell>& cellpool, int SEED){
+  void allocate(mappool::pool<cell>& _cellpool){
+
+    cellpool = &_cellpool;
+    mark();
+
+    if(normalpool.root.size != (size_t)area/lodarea){
+      normalpool.release();
+      if(budget > 0) normalpool.reserve(area/lodarea, "");
+      else normalpool.reserve(area/lodarea);
+    }
+    else normalpool.clear();
 
     // Generate the Node Array
 
+    nodes.resize(maparea);
+
     for(int i = 0; i < mapsize; i++)
     for(int j = 0; j < mapsize; j++){
 
@@ -331,90 +685,216 @@ struct map {
 
       nodes[ind] = {
         tileres*ivec2(i, j),
-        vertexpool.section(tilearea/lodarea, 0, glm::vec3(0), vertexpool.indices.size()),
-        { cellpool.get(tilearea/lodarea), tileres/lodsize }
+        NULL,
+        { cellpool->get(tilearea/lodarea), tileres/lodsize },
+        { normalpool.get(tilearea/lodarea), tileres/lodsize }
       };
 
-      indexnode(vertexpool, nodes[ind]);
-
     }
 
+  }
+
+  void init(mappool::pool<cell>& _cellpool, parallel::pool& workers, int SEED){
+
+    allocate(_cellpool);
+
     // Fill the Node Array
 
     std::cout<<"Generating New World"<<std::endl;
     std::cout<<"Seed: "<<SEED<<std::endl;
 
+    const uint64_t key = terrain::key(SEED);
+
+    if(!terrain::cache.empty() && loadheight(terrain::path(key), key)){
+      std::cout<<"... loaded cached height ..."<<std::endl;
+      invalidate();
+      return;
+    }
+
     std::cout<<"... generating height ..."<<std::endl;
+    generate(workers, SEED);
+
+    if(!terrain::cache.empty() && !saveheight(terrain::path(key), key))
+      std::cout<<"Failed to write terrain cache "<<terrain::path(key)<<std::endl;
+
+    invalidate();
+
+  }
+
+  // Generate the Normalized Height (on the Caller's Workers, which
+  //  are kept over Repeated Generations)
+
+  void generate(parallel::pool& workers, const int SEED){
 
-    static FastNoiseLite noise; //Noise System
-    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
-    noise.SetFractalType(FastNoiseLite::FractalType_FBm);
+    // Every Worker has its own Noise Instance per Octave
 
+    std::vector<std::array<FastNoiseLite, quad::octaves>> noise(workers.size());
+    for(auto& layers: noise){
+      float f = frequency;
+      for(auto& o: layers){
+        o.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
+        o.SetFractalType(FastNoiseLite::FractalType_FBm);
+        o.SetFrequency(f);
+        f *= 2;
+      }
+    }
+
+    // Nodes are split into Chunks of Cells, all Octaves of a Cell
+    //  are summed in one Pass. The Height Range is reduced per Worker.
+
+    const size_t per = tilearea/lodarea;
+    const size_t chunk = (per < 4096) ? per : 4096;
+    const ivec2 res = tileres/lodsize;
+    const float z = (float)(SEED%10000);
+
+    std::vector<vec2> range(workers.size(), vec2(0.0f)); // (Min, Max)
 
     for(auto& node: nodes){
 
-      for(auto [cell, pos]: node.s)
-        cell.height = 0.0f;
+      workers.foreach(per/chunk, [&](const size_t k, const int t){
 
-      // Add Layers of Noise
+        vec2& r = range[t];
 
-      float frequency = 1.0f;
-      float scale = 0.6f;
+        for(size_t i = k*chunk; i < (k + 1)*chunk; i++){
 
-      for(size_t o = 0; o < 8; o++){
+          const vec2 p = vec2(node.pos + lodsize*math::cunflatten(i, res))/vec2(quad::tileres);
 
-        noise.SetFrequency(frequency);
+          float height = 0.0f;
+          float scale = amplitude;
 
-        for(auto [cell, pos]: node.s){
+          for(auto& o: noise[t]){
+            height += scale*o.GetNoise(p.x, p.y, z);
+            scale *= gain;
+          }
 
-          vec2 p = vec2(node.pos+lodsize*pos)/vec2(quad::tileres);
-          cell.height += scale*noise.GetNoise(p.x, p.y, (float)(SEED%10000));
+          node.s.at(i)->height = height;
+          r.x = (r.x < height) ? r.x : height;
+          r.y = (r.y > height) ? r.y : height;
 
         }
 
-        frequency *= 2;
-        scale *= 0.6;
+      });
 
-      }
+      touch(&node);
+      page();
 
     }
 
     float min = 0.0f;
     float max = 0.0f;
 
-    for(auto& node: nodes)
-    for(auto [cell, pos]: node.s){
-      min = (min < cell.height)?min:cell.height;
-      max = (max > cell.height)?max:cell.height;
+    for(auto& r: range){
+      min = (min < r.x) ? min : r.x;
+      max = (max > r.y) ? max : r.y;
+    }
+
+    // Normalize
+
+    for(auto& node: nodes){
+
+      workers.foreach(per/chunk, [&](const size_t k, const int t){
+        for(size_t i = k*chunk; i < (k + 1)*chunk; i++){
+          cellptr c = node.s.at(i);
+          c->height = (c->height - min)/(max - min);
+        }
+      });
+
+      touch(&node);
+      page();
+
+    }
+
+  }
+
+  // Read / Write the Height from / to the Terrain Cache
+
+  bool loadheight(const std::string& path, const uint64_t key){
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      return false;
+
+    const size_t cells = (size_t)area/lodarea;
+    const size_t bytes = sizeof(terrain::header) + sizeof(float)*cells;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size != bytes){
+      close(fd);
+      return false;
+    }
+
+    void* m = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED)
+      return false;
+
+    const terrain::header* h = (const terrain::header*)m;
+    const bool valid = std::memcmp(h->magic, terrain::header().magic, sizeof(h->magic)) == 0
+      && h->key == key && h->cells == cells;
+
+    if(valid){
+
+      const float* height = (const float*)(h + 1);
+      const size_t per = tilearea/lodarea;
+
+      for(auto& node: nodes){
+        cellptr c = node.s.at(0);
+        for(size_t i = 0; i < per; i++, ++c)
+          c->height = height[i];
+        height += per;
+        touch(&node);
+        page();
+      }
+
     }
 
-    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
-    noise.SetFractalType(FastNoiseLite::FractalType_FBm);
-    noise.SetFractalOctaves(1.0f);
-    noise.SetFractalLacunarity(2.0f);
-    noise.SetFractalGain(0.6f);
-    noise.SetFrequency(1.0);
+    munmap(m, bytes);
+    return valid;
+
+  }
+
+  bool saveheight(const std::string& path, const uint64_t key){
+
+    std::error_code error;
+    std::filesystem::create_directories(terrain::cache, error);
+
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    if(!out.is_open())
+      return false;
+
+    terrain::header h;
+    h.key = key;
+    h.cells = (size_t)area/lodarea;
+    out.write((const char*)&h, sizeof(h));
 
-    for(auto& node: nodes)
-    for(auto [cell, pos]: node.s){
+    const size_t per = tilearea/lodarea;
+    std::vector<float> height(per);
 
-      vec2 p = vec2(node.pos+lodsize*pos)/vec2(quad::tileres);
-    //  vec2 cp = p+;
-      float scale = noise.GetNoise(p.x, p.y, (float)(SEED%10000+1));
-      float d = 0.1+0.5f*(1.0f+erf(2*scale));
+    for(auto& node: nodes){
+      cellptr c = node.s.at(0);
+      for(size_t i = 0; i < per; i++, ++c)
+        height[i] = c->height;
+      out.write((const char*)height.data(), sizeof(float)*per);
+      touch(&node);
+      page();
+    }
 
-    // /  float cd = sqrt(dot(cp, cp)/(0.07*size*size));
-      //cell.height = d;
-      cell.height = ((cell.height - min)/(max - min));
+    out.close();
+    if(!out.good() || std::rename(tmp.c_str(), path.c_str()) != 0){
+      std::filesystem::remove(tmp, error);
+      return false;
     }
 
+    return true;
+
   }
 
+  // Note: Negative Positions wrap to large Unsigned Values
+
   const inline bool oob(ivec2 p){
-    if(p.x  < 0)  return true;
-    if(p.y  < 0)  return true;
-    if(p.x >= size)  return true;
-    if(p.y >= size)  return true;
+    if((unsigned int)p.x >= (unsigned int)size)  return true;
+    if((unsigned int)p.y >= (unsigned int)size)  return true;
     return false;
   }
 
@@ -425,11 +905,17 @@ struct map {
     return &nodes[ind];
   }
 
-  inline cell* getCell(ivec2 p){
+  inline cellptr getCell(ivec2 p){
     if(oob(p)) return NULL;
     return get(p)->get(p);
   }
 
+  // Linear Index of a Cell over all Nodes
+
+  inline size_t index(node* n, cellptr c){
+    return (n - nodes.data())*(tilearea/lodarea) + (c - n->s.root.start);
+  }
+
   const inline float height(ivec2 p){
     node* n = get(p);
     if(n == NULL) return 0.0f;
@@ -442,8 +928,240 @@ struct map {
     return n->discharge(p);
   }
 
+  /*
+    Cached Normals:
+
+    A normal is computed on first access and stored in the node's normal
+    slice. Whenever a height changes, the normals that depend on it (the
+    cell and its neighbors) have to be invalidated.
+  */
+
   const inline vec3 normal(ivec2 p){
-    return _normal(*this, p);
+    node* n = get(p);
+    if(n == NULL) return _normal(*this, p);
+    vec4* c = n->n.get((p - n->pos) >> lodshift);
+    if(c->w == 0.0f)
+      *c = vec4(_normal(*this, p), 1.0f);
+    return vec3(c->x, c->y, c->z);
+  }
+
+  // Invalidate the Normals of the Cells within Radius r around
+  //  a Changed Height. A normal only depends on the axial neighbors,
+  //  so the corners of the square are skipped.
+
+  inline void invalidate(ivec2 p, const int r = 1){
+
+    node* n = get(p);
+    if(n == NULL) return;
+
+    // Interior Fast-Path: No Bounds Checks
+
+    const ivec2 l = (p - n->pos) >> lodshift;
+    if(l.x >= r && l.y >= r && l.x < n->n.res.x - r && l.y < n->n.res.y - r){
+      for(int x = -r; x <= r; x++)
+      for(int y = -r; y <= r; y++){
+        if(abs(x) == r && abs(y) == r) continue;
+        n->n.at(math::cflatten(l + ivec2(x, y), n->n.res))->w = 0.0f;
+      }
+      return;
+    }
+
+    for(int x = -r; x <= r; x++)
+    for(int y = -r; y <= r; y++){
+      if(abs(x) == r && abs(y) == r) continue;
+      const ivec2 q = p + lodsize*ivec2(x, y);
+      node* m = get(q);
+      if(m == NULL) continue;
+      m->n.get((q - m->pos) >> lodshift)->w = 0.0f;
+    }
+
+  }
+
+  // Invalidate all Normals
+
+  void invalidate(){
+    for(auto& node: nodes){
+      for(auto [normal, pos]: node.n)
+        normal.w = 0.0f;
+      touch(&node);
+      page();
+    }
+  }
+
+  /*
+    Dirty Cells:
+
+    Writes of a cell's height or root density, and tracked flow, mark it in
+    the dirty bitmap, so that a checkpoint only has to write the cells that
+    changed since the last one (see checkpoint::chain). Marking is thread-safe.
+
+    The bitmap is only kept once a checkpoint chain cleans it: without one,
+    it is empty and marking is skipped.
+  */
+
+  inline void mark(const cellptr c){
+    mark(size_t(c - cellpool->root.start));
+  }
+
+  inline void mark(const size_t i){
+    if(dirty.empty())
+      return;
+    std::atomic_ref<uint64_t> w(dirty[i >> 6]);
+    const uint64_t b = uint64_t(1) << (i & 63);
+    if((w.load(std::memory_order_relaxed) & b) == 0)
+      w.fetch_or(b, std::memory_order_relaxed);
+  }
+
+  // Mark all Cells / Clear the Marks
+
+  void mark(){
+    if(!dirty.empty())
+      dirty.assign((cellpool->root.size + 63)/64, ~uint64_t(0));
+  }
+
+  void clean(){
+    dirty.assign((cellpool->root.size + 63)/64, 0);
+  }
+
+  /*
+    Paging:
+
+    With a budget, the cells live in a file mapping (see cellpool reserve)
+    and the normals in an anonymous mapping. Nodes are marked with the
+    current epoch when accessed, and page() releases the least recently
+    used nodes once more than budget nodes are resident. An evicted node's
+    cells are written back to the file, its normals are dropped (and
+    recomputed, since released anonymous pages read as zero). Any access
+    faults the pages back in, so paging never changes the results.
+
+    Touching is thread-safe, page() must be called from a serial point.
+  */
+
+  inline void touch(node* n){
+    std::atomic_ref<uint32_t>(n->stamp).store(epoch, std::memory_order_relaxed);
+  }
+
+  void page(){
+
+    if(budget == 0)
+      return;
+
+    static std::vector<node*> resident;
+    resident.clear();
+
+    for(auto& n: nodes){
+      if(n.stamp == epoch)
+        n.resident = true;
+      if(n.resident)
+        resident.push_back(&n);
+    }
+
+    epoch++;
+
+    if(resident.size() <= budget)
+      return;
+
+    // Evict Down to 3/4 of the Budget, Least Recently Used First
+
+    std::sort(resident.begin(), resident.end(), [](const node* a, const node* b){
+      if(a->stamp != b->stamp) return a->stamp < b->stamp;
+      return a < b;
+    });
+
+    const size_t keep = (3*budget + 3)/4;
+    for(size_t i = 0; i < resident.size() - keep; i++){
+      cellpool->evict(resident[i]->s.root);
+      normalpool.evict(resident[i]->n.root);
+      resident[i]->resident = false;
+    }
+
+  }
+
+};
+
+/*
+================================================================================
+                    Fused 3x3 Cell Neighborhood (Stencil)
+================================================================================
+  A stencil resolves the 3x3 neighborhood of a cell once, so that the
+  normal, mass transfer and cascade can work on the same cell pointers
+  and heights. If the neighborhood lies inside a single node, the cells
+  are addressed directly without bounds checks.
+*/
+
+struct stencil {
+
+  ivec2 pos;          // Center Position
+  node* n = NULL;     // Center Node
+  cellptr c[9];       // Cells (NULL: Out-Of-Bounds)
+  float h[9];         // Heights (0: Out-Of-Bounds)
+
+  // Index of Offset (x, y) in [-1, 1]
+
+  static constexpr int index(const int x, const int y){
+    return 3*(x + 1) + (y + 1);
+  }
+
+  inline bool load(map& m, const ivec2 p){
+
+    pos = p;
+    n = m.get(p);
+    if(n == NULL)
+      return false;
+
+    m.touch(n);
+
+    const ivec2 l = (p - n->pos) >> lodshift;
+
+    if(l.x >= 1 && l.y >= 1 && l.x < n->s.res.x - 1 && l.y < n->s.res.y - 1){
+
+      for(int x = -1; x <= 1; x++)
+      for(int y = -1; y <= 1; y++){
+        const int i = index(x, y);
+        c[i] = n->s.at(math::cflatten(l + ivec2(x, y), n->s.res));
+        h[i] = c[i]->height;
+      }
+
+    } else {
+
+      for(int x = -1; x <= 1; x++)
+      for(int y = -1; y <= 1; y++){
+        const int i = index(x, y);
+        c[i] = m.getCell(p + lodsize*ivec2(x, y));
+        h[i] = (c[i] == NULL) ? 0.0f : c[i]->height;
+      }
+
+    }
+
+    return true;
+
+  }
+
+  // Surface Normal (Identical to _normal)
+
+  inline vec3 normal() const {
+
+    vec3 n = vec3(0, 0, 0);
+    const vec3 s = vec3(1.0, quad::mapscale, 1.0);
+    const float h0 = h[4];
+
+    if(c[index( 1, 1)] != NULL)
+      n += cross( s*vec3( 0.0, h[index( 0, 1)] - h0, 1.0), s*vec3( 1.0, h[index( 1, 0)] - h0, 0.0));
+
+    if(c[index(-1,-1)] != NULL)
+      n += cross( s*vec3( 0.0, h[index( 0,-1)] - h0,-1.0), s*vec3(-1.0, h[index(-1, 0)] - h0, 0.0));
+
+    //Two Alternative Planes (+X -> -Y) (-X -> +Y)
+    if(c[index( 1,-1)] != NULL)
+      n += cross( s*vec3( 1.0, h[index( 1, 0)] - h0, 0.0), s*vec3( 0.0, h[index( 0,-1)] - h0,-1.0));
+
+    if(c[index(-1, 1)] != NULL)
+      n += cross( s*vec3(-1.0, h[index(-1, 0)] - h0, 0.0), s*vec3( 0.0, h[index( 0, 1)] - h0, 1.0));
+
+    if(length(n) > 0)
+      n = normalize(n);
+    return n;
+
   }
 
 };
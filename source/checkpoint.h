@@ -0,0 +1,577 @@
+#ifndef SIMPLEHYDROLOGY_CHECKPOINT
+#define SIMPLEHYDROLOGY_CHECKPOINT
+
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <bit>
+
+/*
+SimpleHydrology - checkpoint.h
+
+Saves and restores the full simulation state as a binary
+file: a header, the raw cell planes of the cellpool (page-
+aligned, in the pool's memory layout) and the plant list.
+
+A restore maps the cell planes straight into the cellpool
+(copy-on-write), so no per-cell parsing is done. Random
+numbers are counter-based, so the seed and the cycle
+counters are the complete generator state.
+
+A chain of checkpoints only writes a full (base) checkpoint
+once, followed by deltas which contain the cells that were
+written, and is compacted into a new base in the background
+(see chain).
+*/
+
+namespace checkpoint {
+
+const uint32_t version = 3;
+
+// Memory Layout Flags (have to Match for a Restore)
+
+const uint32_t layout = 0
+#ifdef HYDROLOGY_SOA
+  | 1
+#endif
+#ifdef HYDROLOGY_MORTON
+  | 2
+#endif
+#ifdef HYDROLOGY_BLOCKED
+  | 4
+#endif
+  ;
+
+struct header {
+
+  char magic[8] = {'H', 'Y', 'D', 'R', 'O', 'C', 'K', 'P'};
+  uint32_t version = checkpoint::version;
+  uint32_t layout = checkpoint::layout;
+
+  uint32_t cellsize = sizeof(quad::cell);
+  uint32_t plantsize = sizeof(Plant);
+  uint32_t tilesize = quad::tilesize;
+  uint32_t lodsize = quad::lodsize;
+  uint32_t mapsize = 0;
+
+  uint32_t SEED = 0;
+  uint32_t cycle = 0;                 // World::cycle
+  uint32_t tick = 0;                  // Vegetation::tick
+  uint32_t seq = 0;                   // Last Delta Compacted into this Base
+  float decay = -1.0f;                // World::decay
+
+  uint64_t cells = 0;                 // Number of Cells
+  uint64_t celloffset = 0;            // Page-Aligned Cell Planes
+  uint64_t cellbytes = 0;
+  uint64_t plants = 0;                // Number of Plants
+  uint64_t plantoffset = 0;
+
+};
+
+inline uint64_t pagealign(const uint64_t bytes){
+  return (bytes + mappool::pagesize - 1)/mappool::pagesize*mappool::pagesize;
+}
+
+// Write a Checkpoint (to a Temporary File, then Renamed)
+
+bool save(const std::string& path, mappool::pool<quad::cell>& cellpool, const uint32_t seq = 0){
+
+  header h;
+  h.seq = seq;
+  h.mapsize = quad::mapsize;
+  h.SEED = World::SEED;
+  h.cycle = World::cycle;
+  h.tick = Vegetation::tick;
+  h.decay = World::decay;
+
+  h.cells = cellpool.root.size;
+  h.celloffset = pagealign(sizeof(header));
+  h.cellbytes = pagealign(mappool::layout<quad::cell>::bytes(h.cells));
+  h.plants = Vegetation::plants.size();
+  h.plantoffset = h.celloffset + h.cellbytes;
+
+  const std::string tmp = path + ".tmp";
+  std::ofstream out(tmp, std::ios::binary);
+  if(!out.is_open()){
+    std::cout<<"Checkpoint Error: Can't Open "<<tmp<<std::endl;
+    return false;
+  }
+
+  // Pad with Zeros to an Offset
+
+  static const char zero[mappool::pagesize] = {0};
+  size_t at = 0;
+
+  auto write = [&](const char* data, const size_t bytes){
+    out.write(data, bytes);
+    at += bytes;
+  };
+
+  auto pad = [&](const size_t offset){
+    while(at < offset)
+      write(zero, std::min(offset - at, mappool::pagesize));
+  };
+
+  write((const char*)&h, sizeof(header));
+  pad(h.celloffset);
+
+  mappool::layout<quad::cell>::planes(cellpool.root.start, h.cells, [&](char* data, const size_t bytes){
+    write(data, bytes);
+    pad(pagealign(at));
+  });
+
+  pad(h.plantoffset);
+  write((const char*)Vegetation::plants.data(), h.plants*sizeof(Plant));
+
+  out.close();
+  if(!out.good()){
+    std::cout<<"Checkpoint Error: Failed to Write "<<tmp<<std::endl;
+    return false;
+  }
+
+  if(std::rename(tmp.c_str(), path.c_str()) != 0){
+    std::cout<<"Checkpoint Error: Failed to Rename "<<tmp<<std::endl;
+    std::remove(tmp.c_str());
+    return false;
+  }
+
+  return true;
+
+}
+
+// Restore a Checkpoint into an Empty Cellpool and the World
+
+bool load(const std::string& path, mappool::pool<quad::cell>& cellpool, uint32_t* seq = NULL){
+
+  std::ifstream in(path, std::ios::binary);
+  if(!in.is_open()){
+    std::cout<<"Checkpoint Error: Can't Open "<<path<<std::endl;
+    return false;
+  }
+
+  header h, ref;
+  in.read((char*)&h, sizeof(header));
+
+  if(!in.good() || std::string(h.magic, 8) != std::string(ref.magic, 8)){
+    std::cout<<"Checkpoint Error: "<<path<<" is not a Checkpoint"<<std::endl;
+    return false;
+  }
+
+  if(h.version != ref.version || h.layout != ref.layout || h.cellsize != ref.cellsize
+  || h.plantsize != ref.plantsize || h.tilesize != ref.tilesize || h.lodsize != ref.lodsize){
+    std::cout<<"Checkpoint Error: Incompatible Version or Memory Layout"<<std::endl;
+    return false;
+  }
+
+  quad::resize(h.mapsize);
+  if(h.cells != (uint64_t)quad::area/quad::lodarea){
+    std::cout<<"Checkpoint Error: Cell Count doesn't Match the Map Size"<<std::endl;
+    return false;
+  }
+
+  // Map the Cell Planes, Read the Plants
+
+  if(!cellpool.load(h.cells, path, h.celloffset)){
+    std::cout<<"Checkpoint Error: Can't Map "<<path<<std::endl;
+    return false;
+  }
+
+  std::vector<char> buf(h.plants*sizeof(Plant));
+  in.seekg(h.plantoffset);
+  in.read(buf.data(), buf.size());
+  if(!in.good()){
+    std::cout<<"Checkpoint Error: Failed to Read Plants"<<std::endl;
+    return false;
+  }
+
+  const Plant* plants = (const Plant*)buf.data();
+  Vegetation::assign(plants, plants + h.plants);
+
+  World::SEED = h.SEED;
+  World::cycle = h.cycle;
+  Vegetation::tick = h.tick;
+  World::decay = h.decay;
+  if(seq != NULL) *seq = h.seq;
+
+  World::map.allocate(cellpool);
+  World::map.invalidate();
+
+  std::cout<<"Restored Checkpoint "<<path<<" (Seed "<<h.SEED<<", Cycle "<<h.cycle<<")"<<std::endl;
+  return true;
+
+}
+
+/*
+================================================================================
+                      Incremental Checkpoint Chains
+================================================================================
+  After the base, a save writes a delta (path.1, path.2, ...) with the
+  cells marked in the map's dirty bitmap since the last save (written
+  heights and root densities, tracked flow), plus the counters and the
+  plant list. The bitmap is stored as its non-zero words.
+
+  Unmarked cells only had their discharge and momentum decay, which is
+  replayed on restore for the cycles between the two saves (a change of
+  the decay rate marks all cells).
+
+  Every few deltas, a background thread folds them into a copy of the
+  base and renames it over the base. The base records the last delta
+  it contains, so deltas up to that number are skipped on restore.
+*/
+
+struct delta {
+
+  char magic[8] = {'H', 'Y', 'D', 'R', 'O', 'D', 'L', 'T'};
+  uint32_t version = checkpoint::version;
+  uint32_t seq = 0;
+
+  uint32_t SEED = 0;
+  uint32_t cycle = 0;
+  uint32_t tick = 0;
+  uint32_t from = 0;                  // Cycle of the Previous Save
+  float decay = -1.0f;                // World::decay
+  uint32_t cellsize = sizeof(quad::cell);
+
+  uint64_t words = 0;                 // Number of Non-Zero Bitmap Words
+  uint64_t cells = 0;                 // Number of Marked Cells
+  uint64_t plants = 0;                // Number of Plants
+
+};
+
+// Read a Delta's Header, Check it Continues the Chain at (seq, cycle)
+
+inline bool next(std::ifstream& in, delta& d, const uint32_t seq, const uint32_t cycle){
+
+  delta ref;
+  in.read((char*)&d, sizeof(delta));
+  return in.good() && std::string(d.magic, 8) == std::string(ref.magic, 8)
+    && d.version == ref.version && d.cellsize == ref.cellsize
+    && d.seq == seq && d.from == cycle;
+
+}
+
+// Apply a Delta's Cells: Decay of the Unmarked Cells, then the Marked Cells.
+//  The decay repeats the field update of every cycle instead of using a
+//  closed form ((1-l)^k), so that the rounding is bit-identical to erosion.
+
+inline bool apply(std::ifstream& in, const delta& d, const mappool::layout<quad::cell>::ptr cells, const size_t size){
+
+  std::vector<uint64_t> words(2*d.words);
+  in.read((char*)words.data(), words.size()*sizeof(uint64_t));
+  if(!in.good())
+    return false;
+
+  const float l = d.decay;
+  size_t j = 0;
+
+  for(size_t w = 0; 64*w < size; w++){
+
+    uint64_t m = 0;
+    if(j < d.words && words[2*j] == w)
+      m = words[2*j++ + 1];
+
+    for(size_t i = 64*w; i < std::min(64*w + 64, size); i++){
+      if((m >> (i%64)) & 1)
+        continue;
+      auto c = cells + i;
+      for(uint32_t k = d.from; k < d.cycle; k++){
+        c->discharge = (1.0f-l)*c->discharge + l*0.0f;
+        c->momentumx = (1.0f-l)*c->momentumx + l*0.0f;
+        c->momentumy = (1.0f-l)*c->momentumy + l*0.0f;
+      }
+    }
+
+  }
+
+  // Words are Stored in Ascending Order, within the Cells
+
+  if(j != d.words)
+    return false;
+
+  for(size_t w = 0; w < d.words; w++)
+  for(uint64_t m = words[2*w+1]; m != 0; m &= m - 1){
+    const size_t i = 64*words[2*w] + std::countr_zero(m);
+    if(i >= size)
+      return false;
+    mappool::layout<quad::cell>::planes(cells + i, 1, [&](char* data, const size_t bytes){
+      in.read(data, bytes);
+    });
+  }
+
+  return in.good();
+
+}
+
+struct chain {
+
+  std::string path;
+  uint32_t seq = 0;                   // Last Written Delta
+  uint32_t from = 0;                  // Cycle of the Last Save
+  std::atomic<uint32_t> base = 0;     // Last Delta in the Base (Set by the Compactor)
+  bool written = false;               // Base Written (or Restored)
+
+  int compactevery = 8;               // Deltas before Compaction
+  std::thread compactor;
+
+  chain(const std::string& _path):path(_path){}
+  ~chain(){
+    if(compactor.joinable())
+      compactor.join();
+  }
+
+  std::string deltapath(const uint32_t s){
+    return path + "." + std::to_string(s);
+  }
+
+  bool save(mappool::pool<quad::cell>& cellpool);
+  bool load(mappool::pool<quad::cell>& cellpool);
+  bool compact(const uint32_t upto);
+
+};
+
+// Write the Base on the First Save, Deltas Afterwards
+
+bool chain::save(mappool::pool<quad::cell>& cellpool){
+
+  if(!written){
+
+    if(compactor.joinable())
+      compactor.join();
+
+    // Stale Deltas of a Previous Chain
+
+    std::error_code ec;
+    for(uint32_t s = 1; std::filesystem::exists(deltapath(s), ec); s++)
+      std::filesystem::remove(deltapath(s), ec);
+
+    seq = base = 0;
+    if(!checkpoint::save(path, cellpool))
+      return false;
+
+    written = true;
+    from = World::cycle;
+    World::map.clean();
+    return true;
+
+  }
+
+  // Non-Zero Bitmap Words (Index, Mask), Records of the Marked Cells
+
+  const std::vector<uint64_t>& dirty = World::map.dirty;
+
+  std::vector<uint64_t> words;
+  std::vector<char> records;
+  size_t marked = 0;
+
+  for(size_t w = 0; w < dirty.size(); w++){
+    if(dirty[w] == 0)
+      continue;
+    words.push_back(w);
+    words.push_back(dirty[w]);
+    for(uint64_t m = dirty[w]; m != 0; m &= m - 1, marked++)
+      mappool::layout<quad::cell>::planes(cellpool.root.start + (64*w + std::countr_zero(m)), 1, [&](char* data, const size_t bytes){
+        records.insert(records.end(), data, data + bytes);
+      });
+  }
+
+  delta d;
+  d.seq = seq + 1;
+  d.SEED = World::SEED;
+  d.cycle = World::cycle;
+  d.tick = Vegetation::tick;
+  d.from = from;
+  d.decay = World::decay;
+  d.words = words.size()/2;
+  d.cells = marked;
+  d.plants = Vegetation::plants.size();
+
+  const std::string tmp = deltapath(d.seq) + ".tmp";
+  std::ofstream out(tmp, std::ios::binary);
+  if(!out.is_open()){
+    std::cout<<"Checkpoint Error: Can't Open "<<tmp<<std::endl;
+    return false;
+  }
+
+  out.write((const char*)&d, sizeof(delta));
+  out.write((const char*)words.data(), words.size()*sizeof(uint64_t));
+  out.write(records.data(), records.size());
+  out.write((const char*)Vegetation::plants.data(), d.plants*sizeof(Plant));
+
+  out.close();
+  if(!out.good()){
+    std::cout<<"Checkpoint Error: Failed to Write "<<tmp<<std::endl;
+    return false;
+  }
+
+  if(std::rename(tmp.c_str(), deltapath(d.seq).c_str()) != 0){
+    std::cout<<"Checkpoint Error: Failed to Rename "<<tmp<<std::endl;
+    std::remove(tmp.c_str());
+    return false;
+  }
+
+  seq = d.seq;
+  from = World::cycle;
+  World::map.clean();
+
+  // Background Compaction (One at a Time)
+
+  if(seq - base >= (uint32_t)compactevery){
+    if(compactor.joinable())
+      compactor.join();
+    compactor = std::thread([this, upto = seq](){
+      if(compact(upto))
+        base = upto;
+    });
+  }
+
+  return true;
+
+}
+
+// Restore the Base and Apply its Deltas
+
+bool chain::load(mappool::pool<quad::cell>& cellpool){
+
+  uint32_t b = 0;
+  if(!checkpoint::load(path, cellpool, &b))
+    return false;
+
+  base = b;
+  seq = base;
+
+  std::error_code ec;
+  for(uint32_t s = base + 1; std::filesystem::exists(deltapath(s), ec); s++){
+
+    std::ifstream in(deltapath(s), std::ios::binary);
+
+    delta d;
+    if(!next(in, d, s, World::cycle)){
+      std::cout<<"Checkpoint Error: Invalid Delta "<<deltapath(s)<<std::endl;
+      return false;
+    }
+
+    std::vector<char> buf(d.plants*sizeof(Plant));
+    if(!apply(in, d, cellpool.root.start, cellpool.root.size)
+    || !in.read(buf.data(), buf.size())){
+      std::cout<<"Checkpoint Error: Truncated Delta "<<deltapath(s)<<std::endl;
+      return false;
+    }
+
+    const Plant* plants = (const Plant*)buf.data();
+    Vegetation::assign(plants, plants + d.plants);
+
+    World::SEED = d.SEED;
+    World::cycle = d.cycle;
+    World::decay = d.decay;
+    Vegetation::tick = d.tick;
+    seq = s;
+
+  }
+
+  World::map.invalidate();
+  World::map.clean();
+  written = true;
+  from = World::cycle;
+
+  std::cout<<"Applied "<<(seq - base)<<" Checkpoint Deltas (Cycle "<<World::cycle<<")"<<std::endl;
+  return true;
+
+}
+
+// Fold the Deltas up to a Sequence Number into a Copy of the Base
+
+bool chain::compact(const uint32_t upto){
+
+  const std::string tmp = path + ".compact";
+
+  auto fail = [&](const std::string& what){
+    std::cout<<"Checkpoint Error: Compaction Failed ("<<what<<")"<<std::endl;
+    std::error_code ec;
+    std::filesystem::remove(tmp, ec);
+    return false;
+  };
+
+  std::error_code ec;
+  std::filesystem::copy_file(path, tmp, std::filesystem::copy_options::overwrite_existing, ec);
+  if(ec)
+    return fail(ec.message());
+
+  const int fd = ::open(tmp.c_str(), O_RDWR);
+  if(fd < 0)
+    return fail("Can't Open " + tmp);
+
+  header h;
+  if(pread(fd, &h, sizeof(header), 0) != sizeof(header)){
+    close(fd);
+    return fail("Can't Read " + tmp);
+  }
+
+  const size_t bytes = h.celloffset + h.cellbytes;
+  void* m = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(m == MAP_FAILED){
+    close(fd);
+    return fail("Can't Map " + tmp);
+  }
+
+  const mappool::layout<quad::cell>::ptr cells = mappool::layout<quad::cell>::place((char*)m + h.celloffset, h.cells);
+  std::vector<char> plants;
+  std::string error;
+
+  for(uint32_t s = h.seq + 1; s <= upto && error.empty(); s++){
+
+    std::ifstream in(deltapath(s), std::ios::binary);
+
+    delta d;
+    if(!next(in, d, s, h.cycle)){
+      error = "Invalid Delta " + deltapath(s);
+      break;
+    }
+
+    plants.resize(d.plants*sizeof(Plant));
+    if(!apply(in, d, cells, h.cells) || !in.read(plants.data(), plants.size()))
+      error = "Truncated Delta " + deltapath(s);
+
+    h.SEED = d.SEED;
+    h.cycle = d.cycle;
+    h.tick = d.tick;
+    h.decay = d.decay;
+    h.seq = s;
+    h.plants = d.plants;
+
+  }
+
+  msync(m, bytes, MS_SYNC);
+  munmap(m, bytes);
+
+  // Header and Plants, which are Stored Last
+
+  if(error.empty() && !(ftruncate(fd, h.plantoffset) == 0
+    && pwrite(fd, plants.data(), plants.size(), h.plantoffset) == (ssize_t)plants.size()
+    && pwrite(fd, &h, sizeof(header), 0) == sizeof(header)
+    && fsync(fd) == 0))
+    error = "Can't Write " + tmp;
+
+  close(fd);
+
+  if(!error.empty())
+    return fail(error);
+
+  if(std::rename(tmp.c_str(), path.c_str()) != 0)
+    return fail("Can't Rename " + tmp);
+
+  for(uint32_t s = 1; s <= upto; s++){
+    std::filesystem::remove(deltapath(s), ec);
+    if(ec)
+      std::cout<<"Checkpoint Error: Can't Remove "<<deltapath(s)<<" ("<<ec.message()<<")"<<std::endl;
+  }
+
+  return true;
+
+}
+
+}; // namespace checkpoint
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SIMPLEHYDROLOGY_EXPORT
+#define SIMPLEHYDROLOGY_EXPORT
+
+#include <fstream>
+#include <string>
+
+/*
+SimpleHydrology - export.h
+
+Writes map fields to disk as 16-bit
+greyscale images (binary PGM), so that
+headless runs can be inspected.
+*/
+
+namespace field {
+
+// Sample a Field in [0, 1] over a Resolution, Write as PGM
+
+template<typename F>
+bool save(const std::string& path, F f, const ivec2 res){
+
+  std::ofstream out(path, std::ios::binary);
+  if(!out.is_open()){
+    std::cout<<"Export Error: Can't Open "<<path<<std::endl;
+    return false;
+  }
+
+  out<<"P5\n"<<res.x<<" "<<res.y<<"\n65535\n";
+
+  std::vector<unsigned char> row(2*res.x);
+  for(int y = 0; y < res.y; y++){
+    for(int x = 0; x < res.x; x++){
+      float v = f(ivec2(x, y));
+      if(v < 0.0f) v = 0.0f;
+      if(v > 1.0f) v = 1.0f;
+      const unsigned int u = (unsigned int)(v*65535.0f + 0.5f);
+      row[2*x+0] = (u >> 8) & 0xFF;   // PGM is Big-Endian
+      row[2*x+1] = (u >> 0) & 0xFF;
+    }
+    out.write((const char*)row.data(), row.size());
+  }
+
+  return out.good();
+
+}
+
+// Export the Main Fields of a Map with a Filename Prefix
+
+bool save(const std::string& prefix, quad::map& map){
+
+  bool ok = true;
+
+  ok &= save(prefix + "height.pgm", [&](const ivec2 p){
+    return map.height(p);
+  }, quad::res);
+
+  ok &= save(prefix + "discharge.pgm", [&](const ivec2 p){
+    return map.discharge(p);
+  }, quad::res);
+
+  ok &= save(prefix + "momentumx.pgm", [&](const ivec2 p){
+    return 0.5f*(1.0f+erf(map.getCell(p)->momentumx));
+  }, quad::res);
+
+  ok &= save(prefix + "momentumy.pgm", [&](const ivec2 p){
+    return 0.5f*(1.0f+erf(map.getCell(p)->momentumy));
+  }, quad::res);
+
+  return ok;
+
+}
+
+}; // namespace field
+
+#endif
@@ -10,16 +10,64 @@ using namespace glm;
 
 inline int flatten(ivec2 p, ivec2 s){
   return p.x * s.y + p.y;
-//  return libmorton::morton2D_32_encode(p.x, p.y);
 }
 
 inline ivec2 unflatten(int index, ivec2 s){
   int y = ( index / 1   ) % s.x;
   int x = ( index / s.x ) % s.y;
   return ivec2(x, y);
-  //  return libmorton::morton2D_32_encode(p.x, p.y);
 }
 
+/*
+  Cell Layout Indexing:
+
+  The order of cells inside a map slice is selected at compile time.
+  By default, cells are stored row-major like flatten.
+
+  HYDROLOGY_MORTON:   Z-Order curve (requires square, power-of-two slices).
+                      Uses BMI2 pdep / pext when compiled with -mbmi2.
+  HYDROLOGY_BLOCKED:  Row-major blocks of 8x8 cells, row-major inside
+                      (requires slice sizes divisible by 8).
+*/
+
+#if defined(HYDROLOGY_MORTON)
+
+inline int cflatten(ivec2 p, ivec2 s){
+  return libmorton::morton2D_32_encode(p.x, p.y);
+}
+
+inline ivec2 cunflatten(int index, ivec2 s){
+  uint_fast16_t x, y;
+  libmorton::morton2D_32_decode(index, x, y);
+  return ivec2(x, y);
+}
+
+#elif defined(HYDROLOGY_BLOCKED)
+
+inline int cflatten(ivec2 p, ivec2 s){
+  const int block = (p.x >> 3) * (s.y >> 3) + (p.y >> 3);
+  return (block << 6) + ((p.x & 7) << 3) + (p.y & 7);
+}
+
+inline ivec2 cunflatten(int index, ivec2 s){
+  const int block = index >> 6;
+  const int x = ((block / (s.y >> 3)) << 3) + ((index >> 3) & 7);
+  const int y = ((block % (s.y >> 3)) << 3) + (index & 7);
+  return ivec2(x, y);
+}
+
+#else
+
+inline int cflatten(ivec2 p, ivec2 s){
+  return flatten(p, s);
+}
+
+inline ivec2 cunflatten(int index, ivec2 s){
+  return unflatten(index, s);
+}
+
+#endif
+
 }
 
 
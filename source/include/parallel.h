@@ -0,0 +1,134 @@
+#ifndef SIMPLEHYDROLOGY_PARALLEL
+#define SIMPLEHYDROLOGY_PARALLEL
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/*
+================================================================================
+                          Persistent Worker Pool
+================================================================================
+  The workers are created once and wait for a task. A task is an index
+  range [0, n) which is handed out one index at a time, so that uneven
+  work per index is balanced. The calling thread participates as worker 0.
+*/
+
+namespace parallel {
+
+struct pool {
+
+  std::vector<std::thread> workers;
+
+  std::mutex m;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  std::function<void(size_t, int)> task;
+  std::atomic<size_t> next = 0;
+  size_t n = 0;
+
+  unsigned int generation = 0;  // Incremented per Task
+  int running = 0;              // Workers still Busy
+  bool stop = false;
+
+  pool(){}
+  pool(int threads){
+    init(threads);
+  }
+
+  ~pool(){
+    clear();
+  }
+
+  const inline int size(){
+    return workers.size() + 1;
+  }
+
+  void init(int threads){
+
+    clear();
+    stop = false;
+
+    for(int t = 1; t < threads; t++)
+      workers.emplace_back([this, t](){ work(t); });
+
+  }
+
+  void clear(){
+
+    {
+      std::unique_lock<std::mutex> lock(m);
+      stop = true;
+    }
+    wake.notify_all();
+
+    for(auto& w: workers)
+      w.join();
+    workers.clear();
+
+  }
+
+  // Execute f(i, worker) for all i in [0, n), Return when Done
+
+  template<typename F>
+  void foreach(const size_t _n, F&& f){
+
+    if(workers.empty() || _n <= 1){
+      for(size_t i = 0; i < _n; i++)
+        f(i, 0);
+      return;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(m);
+      task = f;
+      n = _n;
+      next = 0;
+      running = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+
+    for(size_t i = next++; i < n; i = next++)
+      f(i, 0);
+
+    std::unique_lock<std::mutex> lock(m);
+    done.wait(lock, [this](){ return running == 0; });
+
+  }
+
+private:
+
+  void work(const int t){
+
+    unsigned int seen = 0;
+
+    while(true){
+
+      {
+        std::unique_lock<std::mutex> lock(m);
+        wake.wait(lock, [&](){ return stop || generation != seen; });
+        if(stop) return;
+        seen = generation;
+      }
+
+      for(size_t i = next++; i < n; i = next++)
+        task(i, t);
+
+      std::unique_lock<std::mutex> lock(m);
+      if(--running == 0)
+        done.notify_one();
+
+    }
+
+  }
+
+};
+
+}; // namespace parallel
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SIMPLEHYDROLOGY_RANDOM
+#define SIMPLEHYDROLOGY_RANDOM
+
+#include <cstdint>
+
+/*
+================================================================================
+                      Counter-Based Random Numbers
+================================================================================
+  Every random number is a pure function of a key and a counter, using the
+  "Squares" generator (Widynski, 2020). The key is hashed from the seed,
+  the stream and the cycle, and the counter from an index (e.g. tile and
+  particle) plus the number of draws made so far.
+
+  This way, the random numbers of any particle can be computed on any
+  thread and in any order, without shared generator state.
+*/
+
+namespace rng {
+
+// Independent Random Streams
+
+enum stream: uint64_t {
+  EROSION = 1,
+  VEGETATION = 2
+};
+
+// Hash for Key Generation
+
+inline uint64_t splitmix(uint64_t x){
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Squares Counter-Based Generator (32-Bit Output)
+
+inline uint32_t squares(const uint64_t ctr, const uint64_t key){
+  uint64_t x = ctr*key;
+  const uint64_t y = x;
+  const uint64_t z = y + key;
+  x = x*x + y; x = (x >> 32) | (x << 32);
+  x = x*x + z; x = (x >> 32) | (x << 32);
+  x = x*x + y; x = (x >> 32) | (x << 32);
+  return (x*x + z) >> 32;
+}
+
+// Random Number Sequence for one Index
+
+struct counter {
+
+  uint64_t key;
+  uint64_t ctr;
+
+  counter(const uint64_t seed, const uint64_t stream, const uint64_t cycle, const uint64_t index){
+    key = splitmix(seed ^ splitmix(stream ^ splitmix(cycle))) | 1;
+    ctr = index << 16;  // 65536 Draws per Index
+  }
+
+  inline uint32_t operator()(){
+    return squares(ctr++, key);
+  }
+
+  inline int operator()(const int n){
+    return (*this)()%n;
+  }
+
+  inline float uniform(){
+    return (float)((*this)() >> 8)/(float)(1 << 24);
+  }
+
+};
+
+}; // namespace rng
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SIMPLEHYDROLOGY_SLOTMAP
+#define SIMPLEHYDROLOGY_SLOTMAP
+
+#include <cstdint>
+#include <vector>
+
+/*
+================================================================================
+                              Dense Slot Map
+================================================================================
+  Elements are stored densely (contiguous, iterable in dense order) and
+  removed by swapping the last element into their place, so insertion
+  and removal are O(1). The dense order changes on removal.
+
+  Every element also has a stable handle (slot and generation), which
+  stays valid until the element is removed. Freed slots are reused with
+  an incremented generation, so stale handles are detected.
+
+  The number of elements is bounded by the capacity: insertion into a
+  full slot map fails and returns an invalid handle.
+*/
+
+namespace slotmap {
+
+struct handle {
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+  inline bool valid() const { return slot != UINT32_MAX; }
+};
+
+template<typename T>
+struct map {
+
+  size_t capacity = SIZE_MAX;       // Maximum Number of Elements
+
+  std::vector<T> dense;             // Elements
+  std::vector<uint32_t> owner;      // Slot of a Dense Element
+
+  struct slot {
+    uint32_t index = 0;             // Dense Index (or Next Free Slot)
+    uint32_t generation = 0;
+  };
+
+  std::vector<slot> slots;
+  uint32_t free = UINT32_MAX;       // Free Slot List
+
+  // Dense Access
+
+  inline size_t size() const { return dense.size(); }
+  inline bool empty() const { return dense.empty(); }
+  inline bool full() const { return dense.size() >= capacity; }
+
+  inline T& operator[](const size_t i){ return dense[i]; }
+  inline T& back(){ return dense.back(); }
+  inline T* data(){ return dense.data(); }
+
+  typename std::vector<T>::iterator begin(){ return dense.begin(); }
+  typename std::vector<T>::iterator end(){ return dense.end(); }
+
+  // Handle Access (NULL: Removed)
+
+  inline T* get(const handle h){
+    if(h.slot >= slots.size() || slots[h.slot].generation != h.generation)
+      return NULL;
+    return &dense[slots[h.slot].index];
+  }
+
+  inline handle at(const size_t i) const {
+    return { owner[i], slots[owner[i]].generation };
+  }
+
+  // Insert at the End of the Dense Array
+
+  template<typename... Args>
+  handle insert(Args&&... args){
+
+    if(full())
+      return handle();
+
+    uint32_t s = free;
+    if(s != UINT32_MAX)
+      free = slots[s].index;
+    else {
+      s = slots.size();
+      slots.emplace_back();
+    }
+
+    slots[s].index = dense.size();
+    dense.emplace_back(std::forward<Args>(args)...);
+    owner.push_back(s);
+
+    return { s, slots[s].generation };
+
+  }
+
+  // Remove the Element at Dense Index i (the Last Element takes its Place)
+
+  void erase(const size_t i){
+
+    const uint32_t s = owner[i];
+
+    if(i + 1 < dense.size()){
+      dense[i] = std::move(dense.back());
+      owner[i] = owner.back();
+      slots[owner[i]].index = i;
+    }
+
+    dense.pop_back();
+    owner.pop_back();
+
+    slots[s].generation++;
+    slots[s].index = free;
+    free = s;
+
+  }
+
+  bool erase(const handle h){
+    if(get(h) == NULL)
+      return false;
+    erase(slots[h.slot].index);
+    return true;
+  }
+
+  void clear(){
+    dense.clear();
+    owner.clear();
+    slots.clear();
+    free = UINT32_MAX;
+  }
+
+  // Replace all Elements (New Handles, in Order)
+
+  void assign(const T* first, const T* last){
+    clear();
+    for(const T* t = first; t != last; t++)
+      insert(*t);
+  }
+
+};
+
+}; // namespace slotmap
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SIMPLEHYDROLOGY_INSTANCEPOOL
+#define SIMPLEHYDROLOGY_INSTANCEPOOL
+
+/*
+================================================================================
+                    Persistently Mapped Instance Ring Buffer
+================================================================================
+  Per-instance attributes of an instanced model, stored in a persistently
+  mapped buffer that is split into K sections. Every update writes the
+  next section while the GPU may still read the previous ones, and waits
+  on the fence of its last draw before writing (normally already passed).
+
+  Instances are marked when they change (mark), and an update only writes
+  the instances marked since the section was last written. The sections
+  are sized to the number of instances, and reallocated (doubled) when
+  they are too small, which rewrites all instances.
+
+  T has to consist of 1 to 4 floats (one vertex attribute).
+*/
+
+template<typename T>
+class Instancepool {
+private:
+
+static const int K = 3;     //Number of Sections
+
+GLuint vbo = 0;             //Instance Buffer Object
+GLuint vao;                 //Vertex Array Object (of the Model)
+GLuint binding;             //Vertex Buffer Binding Index
+
+size_t N = 0;               //Number of Instances per Section
+int cur = 0;                //Section of the Last Update
+
+T* start = NULL;
+GLsync fence[K] = {NULL};
+
+std::vector<uint8_t> stale;         //Sections to Rewrite (Bit k: Section k), per Instance
+std::vector<size_t> pending[K];     //Instances to Rewrite, per Section
+
+void wait(const int k){
+  if(fence[k] == NULL)
+    return;
+  while(glClientWaitSync(fence[k], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+  glDeleteSync(fence[k]);
+  fence[k] = NULL;
+}
+
+void release(){
+  if(start == NULL)
+    return;
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glDeleteBuffers(1, &vbo);
+  start = NULL;
+}
+
+// (Re-)Allocate the Sections for n Instances, all Instances are Stale
+
+void allocate(const size_t n){
+
+  for(int k = 0; k < K; k++)
+    wait(k);
+  release();
+
+  N = n;
+  const GLbitfield flag = GL_MAP_WRITE_BIT |
+                          GL_MAP_PERSISTENT_BIT |
+                          GL_MAP_COHERENT_BIT;
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferStorage(GL_ARRAY_BUFFER, K*N*sizeof(T), NULL, flag);
+  start = (T*)glMapBufferRange(GL_ARRAY_BUFFER, 0, K*N*sizeof(T), flag);
+
+  glBindVertexArray(vao);
+  glBindVertexBuffer(binding, vbo, 0, sizeof(T));
+
+  stale.clear();
+  for(int k = 0; k < K; k++)
+    pending[k].clear();
+
+}
+
+public:
+
+size_t SIZE = 0;            //Number of Instances (Current Section)
+size_t written = 0;         //Instances Written by the Last Update
+
+Instancepool(){}
+
+~Instancepool(){
+
+  for(int k = 0; k < K; k++)
+  if(fence[k] != NULL)
+    glDeleteSync(fence[k]);
+
+  release();
+
+}
+
+// Add the Attribute to the Model's VAO, Allocate Sections for n Instances
+
+void reserve(const GLuint _vao, const GLuint location, const size_t n){
+
+  static_assert(sizeof(T)%sizeof(GLfloat) == 0 && sizeof(T) <= 4*sizeof(GLfloat));
+
+  vao = _vao; binding = location;
+
+  glBindVertexArray(vao);
+  glEnableVertexAttribArray(location);
+  glVertexAttribFormat(location, sizeof(T)/sizeof(GLfloat), GL_FLOAT, GL_FALSE, 0);
+  glVertexAttribBinding(location, binding);
+  glVertexBindingDivisor(binding, 1);
+
+  allocate((n > 0) ? n : 1);
+
+}
+
+// Instance i Changed: Rewrite it in every Section
+
+void mark(const size_t i){
+
+  if(i >= stale.size())
+    return;
+
+  for(int k = 0; k < K; k++)
+  if((stale[i] & (1 << k)) == 0){
+    stale[i] |= (1 << k);
+    pending[k].push_back(i);
+  }
+
+}
+
+// Write the Marked Instances (f(i) -> T) of n Instances to the Next Section
+
+template<typename F>
+void update(const size_t n, F f){
+
+  if(start == NULL)
+    return;
+
+  if(n > N)
+    allocate(2*n);
+
+  // New Instances are Stale in every Section
+
+  const size_t m = stale.size();
+  stale.resize(n, 0);
+  for(size_t i = m; i < n; i++)
+    mark(i);
+
+  cur = (cur+1)%K;
+  wait(cur);
+
+  T* section = start + cur*N;
+  written = 0;
+
+  for(const size_t i: pending[cur]){
+    if(i >= n || (stale[i] & (1 << cur)) == 0)
+      continue;
+    stale[i] &= ~(1 << cur);
+    section[i] = f(i);
+    written++;
+  }
+
+  pending[cur].clear();
+  SIZE = n;
+
+}
+
+// Draw the Model once per Instance of the Current Section
+
+void render(const GLenum mode, const size_t vertices){
+
+  if(start == NULL || SIZE == 0)
+    return;
+
+  glBindVertexArray(vao);
+  glBindVertexBuffer(binding, vbo, cur*N*sizeof(T), sizeof(T));
+  glDrawArraysInstanced(mode, 0, vertices, SIZE);
+
+  if(fence[cur] != NULL)
+    glDeleteSync(fence[cur]);
+  fence[cur] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+}
+
+};
+
+#endif
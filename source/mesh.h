@@ -0,0 +1,102 @@
+#ifndef SIMPLEHYDROLOGY_MESH
+#define SIMPLEHYDROLOGY_MESH
+
+/*
+SimpleHydrology - mesh.h
+
+Builds the surface mesh for the
+map nodes in the vertexpool. This is
+only needed for rendering.
+
+The vertexpool type V only needs to provide
+the fill / section / index interface of
+TinyEngine's Vertexpool<Vertex>, so that the
+mesh update can also run without OpenGL.
+*/
+
+namespace quad {
+
+template<typename V>
+void indexnode(V& vertexpool, quad::node& t){
+
+  // Iterate over the Node's Slice
+  for(const auto& [cell, pos]: t.s){
+    if(pos.x == tilesize/lodsize - 1) continue;
+    if(pos.y == tilesize/lodsize - 1) continue;
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(0, 0), tileres/lodsize));
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(0, 1), tileres/lodsize));
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(1, 0), tileres/lodsize));
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(1, 0), tileres/lodsize));
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(0, 1), tileres/lodsize));
+    vertexpool.indices.push_back(math::cflatten(pos + ivec2(1, 1), tileres/lodsize));
+  }
+
+  // Side-Drapes
+
+  /*
+  for(size_t i = 0; i < tilesize/lodsize - 1; i++){
+    vertexpool.indices.push_back(i);
+    vertexpool.indices.push_back(tilesize + i);
+    vertexpool.indices.push_back(tilesize + i + 1);
+    vertexpool.indices.push_back(i+1);
+    vertexpool.indices.push_back(tilesize + i + 1);
+    vertexpool.indices.push_back(tilesize + i);
+  }
+  */
+
+  // Update the Vertexpool Properties
+  vertexpool.resize(t.vertex, vertexpool.indices.size());
+  vertexpool.index();
+  vertexpool.update();
+
+}
+
+template<typename V>
+void updatenode(V& vertexpool, quad::map& map, quad::node& t){
+
+  for(auto [cell, pos]: t.s){
+
+    glm::vec2 p = t.pos + lodsize*pos;
+    glm::vec2 pT = t.pos + lodsize*(pos + ivec2( 1, 0));
+    glm::vec2 pB = t.pos + lodsize*(pos + ivec2( 0, 1));
+
+    glm::vec3 P = glm::vec3(p.x, quad::mapscale*t.height(p), p.y);
+    glm::vec3 T = glm::vec3(pT.x, quad::mapscale*t.height(pT), pT.y);
+    glm::vec3 B = glm::vec3(pB.x, quad::mapscale*t.height(pB), pB.y);
+
+    vertexpool.fill(t.vertex, math::cflatten(pos, tileres/lodsize),
+      P,
+      map.normal(p),
+      T - P,
+      B - P
+    );
+
+  }
+
+  /*
+  for(size_t i = 0; i < tilesize/lodsize; i++){
+    vertexpool.fill(t.vertex, tilesize + i,
+      glm::vec3(0, -10, i),
+      glm::vec3(1, 0, 0),
+      glm::vec3(0, 1, 0),
+      glm::vec3(0, 0, 1)
+    );
+  }*/
+
+}
+
+// Section the Vertexpool for every Node of the Map
+
+template<typename V>
+void mesh(V& vertexpool, quad::map& map){
+
+  for(auto& node: map.nodes){
+    node.vertex = vertexpool.section(tilearea/lodarea, 0, glm::vec3(0), vertexpool.indices.size());
+    indexnode(vertexpool, node);
+  }
+
+}
+
+}; // namespace quad
+
+#endif
@@ -29,21 +29,37 @@ glm::vec3 lightPos = normalize(glm::vec3(50.0f, 25.0f, -50.0f));
 glm::vec3 lightCol = glm::vec3(1.0f, 0.95f, 0.95f);
 float lightStrength = 1.4;
 
-//Depth Map Rendering
+//Depth Map Rendering (Sized to the World in initdepth)
 
-glm::vec3 worldcenter = glm::vec3(quad::res.x/2, quad::mapscale/2, quad::res.y/2);
+glm::vec3 worldcenter;
 
 //Matrix for Making Stuff Face Towards Light (Trees)
-float ds = quad::mapsize*400;
-glm::mat4 dp = glm::ortho<float>(-ds, ds, -ds, ds, -ds, ds);
-glm::mat4 dv = glm::lookAt(worldcenter + lightPos, worldcenter, glm::vec3(0,1,0));
+float ds;
+glm::mat4 dp;
+glm::mat4 dv;
 glm::mat4 bias = glm::mat4(
     0.5, 0.0, 0.0, 0.0,
     0.0, 0.5, 0.0, 0.0,
     0.0, 0.0, 0.5, 0.0,
     0.5, 0.5, 0.5, 1.0
 );
-glm::mat4 dvp = dp*dv;
-glm::mat4 dbvp = bias*dvp;
+glm::mat4 dvp;
+glm::mat4 dbvp;
+
+void initdepth(){
+  worldcenter = glm::vec3(quad::res.x/2, quad::mapscale/2, quad::res.y/2);
+  ds = quad::mapsize*400;
+  dp = glm::ortho<float>(-ds, ds, -ds, ds, -ds, ds);
+  dv = glm::lookAt(worldcenter + lightPos, worldcenter, glm::vec3(0,1,0));
+  dvp = dp*dv;
+  dbvp = bias*dvp;
+}
+
+//Tree Instance (16 Bytes: Translation and Scale, the Model Matrix is built in tree.vs)
+
+struct TreeInstance {
+  glm::vec3 pos;
+  float size;
+};
 
 #endif
@@ -0,0 +1,191 @@
+#ifndef SIMPLEHYDROLOGY_MULTIGRID
+#define SIMPLEHYDROLOGY_MULTIGRID
+
+#include <bit>
+
+/*
+SimpleHydrology - multigrid.h
+
+Coarse-to-fine erosion: the map is first eroded at a coarse
+level of detail until the discharge network converges. Its
+erosion (eroded minus generated height), discharge and
+momentum are then upsampled onto the next finer level, which
+is generated from the same noise and continues from there.
+
+A level with lodsize s has 1/s^2 of the cells and drops, and
+drops cross it in 1/s of the steps.
+*/
+
+namespace multigrid {
+
+// Parameters
+
+float tolerance = 0.02f;    // Relative Drainage Change between Windows for Convergence
+int window = 20;            // Cycles per Window (Twice the EMA Time Constant 1/lrate)
+int mincycles = 60;         // Cycles per Level before Convergence
+int maxcycles = 400;        // Maximum Cycles per Level
+
+// Number of Levels at which a Cell is the Size of a Tile (lodsize = tilesize)
+
+inline int maxlevels(){
+  return std::countr_zero((unsigned int)quad::tilesize);
+}
+
+// Fields of a Level, Row-Major over its Cells
+
+struct grid {
+
+  int lod = 0;              // Level of Detail (Shift)
+  ivec2 res = ivec2(0);
+  std::vector<vec4> f;      // (Erosion, Discharge, Momentum X, Momentum Y)
+
+  inline vec4& at(const ivec2 c){
+    return f[c.x*res.y + c.y];
+  }
+
+  // Bilinear Sample at a World Position
+
+  vec4 sample(const vec2 p){
+    const vec2 u = p/(float)(1 << lod);
+    const ivec2 i0 = clamp(ivec2(floor(u)), ivec2(0), res - 1);
+    const ivec2 i1 = min(i0 + 1, res - 1);
+    const vec2 t = clamp(u - vec2(i0), vec2(0), vec2(1));
+    return mix(
+      mix(at(i0), at(ivec2(i0.x, i1.y)), t.y),
+      mix(at(ivec2(i1.x, i0.y)), at(i1), t.y),
+    t.x);
+  }
+
+};
+
+grid snapshot(quad::map& map){
+
+  grid g;
+  g.lod = quad::lodshift;
+  g.res = quad::res >> quad::lodshift;
+  g.f.resize(g.res.x*g.res.y);
+
+  for(auto& node: map.nodes)
+  for(auto [cell, pos]: node.s)
+    g.at((node.pos >> quad::lodshift) + pos) = vec4(cell.height, cell.discharge, cell.momentumx, cell.momentumy);
+
+  return g;
+
+}
+
+// Add the Erosion of a Coarser Level, Take over its Flow
+
+void upsample(quad::map& map, grid& coarse){
+
+  // Drop Speed (and Momentum) Scales with the Level of Detail
+  const float s = (float)quad::lodsize/(float)(1 << coarse.lod);
+
+  for(auto& node: map.nodes)
+  for(auto [cell, pos]: node.s){
+    const vec4 c = coarse.sample(vec2(node.pos + quad::lodsize*pos));
+    cell.height += c.x;
+    cell.discharge = c.y;
+    cell.momentumx = s*c.z;
+    cell.momentumy = s*c.w;
+  }
+
+  map.invalidate();
+  map.mark();
+
+}
+
+// Mean Drainage of a Level: Mean of erf(0.4 discharge) over its Cells
+
+double drainage(quad::map& map){
+  double sum = 0.0;
+  size_t n = 0;
+  for(auto& node: map.nodes)
+  for(auto [cell, pos]: node.s){
+    sum += erf(0.4f*cell.discharge);
+    n++;
+  }
+  return sum/n;
+}
+
+// Erode until the Drainage Settles: The discharge is a moving average of the
+//  drop tracks (rate lrate), so its change per cycle is about lrate times the
+//  noise of the tracks, also when the drainage network doesn't change. The
+//  drainage is therefore averaged over windows of cycles, and the level has
+//  converged when consecutive windows differ by less than tolerance (twice).
+
+size_t converge(quad::map& map){
+
+  size_t drops = 0;
+  double sum = 0.0, prev = -1.0;
+  int settled = 0;
+
+  for(int n = 0; n < maxcycles; n++){
+
+    drops += World::erode(quad::tilesize/quad::lodarea);
+    sum += drainage(map);
+
+    if((n + 1)%window != 0)
+      continue;
+
+    const double mean = sum/window;
+    settled = (prev > 0.0 && abs(mean - prev) <= tolerance*mean) ? settled + 1 : 0;
+    prev = mean;
+    sum = 0.0;
+
+    if(n + 1 >= mincycles && settled >= 2){
+      std::cout<<"... level "<<quad::lodshift<<" converged after "<<(n+1)<<" cycles ..."<<std::endl;
+      return drops;
+    }
+
+  }
+
+  std::cout<<"... level "<<quad::lodshift<<" stopped after "<<maxcycles<<" cycles ..."<<std::endl;
+  return drops;
+
+}
+
+// Run the Coarse Levels, then Initialize the Full Resolution Map in cellpool
+
+size_t run(mappool::pool<quad::cell>& cellpool, parallel::pool& workers, const int levels, const unsigned int SEED){
+
+  grid coarse;
+  size_t drops = 0;
+
+  for(int l = levels; l >= 0; l--){
+
+    quad::setlod(l);
+
+    mappool::pool<quad::cell> pool;
+    if(l > 0)
+      pool.reserve(quad::area/quad::lodarea);
+
+    World::map.init((l > 0) ? pool : cellpool, workers, SEED);
+
+    if(l == 0){
+      if(levels > 0)
+        upsample(World::map, coarse);
+      break;
+    }
+
+    grid generated = snapshot(World::map);
+
+    if(l < levels)
+      upsample(World::map, coarse);
+
+    drops += converge(World::map);
+
+    // Erosion Relative to the Generated Height
+
+    coarse = snapshot(World::map);
+    for(size_t i = 0; i < coarse.f.size(); i++)
+      coarse.f[i].x -= generated.f[i].x;
+
+  }
+
+  return drops;
+
+}
+
+}; // namespace multigrid
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef SIMPLEHYDROLOGY_PARAM
+#define SIMPLEHYDROLOGY_PARAM
+
+#include <string>
+
+/*
+SimpleHydrology - param.h
+
+Parameter policies for the erosion kernels, and a registry
+of the runtime parameters by name. The kernels
+(World::erode, Drop::descend, World::cascade, Wavefront)
+are templated on a policy and read every parameter as P::name.
+
+The runtime policy refers to the mutable statics, so that they
+can still be changed while the simulation runs. The presets
+are compile-time constants, so their kernels are specialized
+(e.g. the momentum transfer is removed with momentumTransfer = 0).
+*/
+
+namespace param {
+
+// Runtime Statics
+
+struct runtime {
+
+  static constexpr float& maxAge = Drop::maxAge;
+  static constexpr float& minVol = Drop::minVol;
+  static constexpr float& evapRate = Drop::evapRate;
+  static constexpr float& depositionRate = Drop::depositionRate;
+  static constexpr float& entrainment = Drop::entrainment;
+  static constexpr float& gravity = Drop::gravity;
+  static constexpr float& momentumTransfer = Drop::momentumTransfer;
+
+  static constexpr float& lrate = World::lrate;
+  static constexpr float& maxdiff = World::maxdiff;
+  static constexpr float& settling = World::settling;
+
+};
+
+// Presets
+
+struct standard {             // Same as the Default Statics
+
+  static constexpr float maxAge = 500;
+  static constexpr float minVol = 0.01f;
+  static constexpr float evapRate = 0.001f;
+  static constexpr float depositionRate = 0.1f;
+  static constexpr float entrainment = 10.0f;
+  static constexpr float gravity = 1.0f;
+  static constexpr float momentumTransfer = 1.0f;
+
+  static constexpr float lrate = 0.1f;
+  static constexpr float maxdiff = 0.01f;
+  static constexpr float settling = 0.8f;
+
+};
+
+struct nomomentum: standard { // Drops ignore the Momentum Map
+
+  static constexpr float momentumTransfer = 0.0f;
+
+};
+
+// Preset Selection
+
+enum preset {
+  RUNTIME,
+  STANDARD,
+  NOMOMENTUM
+};
+
+preset active = RUNTIME;      // Policy of World::erode(cycles)
+
+const char* names[] = {
+  "runtime",
+  "standard",
+  "nomomentum"
+};
+
+bool parse(const std::string& name, preset& p){
+  for(int i = 0; i <= NOMOMENTUM; i++)
+  if(name == names[i]){
+    p = (preset)i;
+    return true;
+  }
+  return false;
+}
+
+// Runtime Parameter Registry
+
+struct entry {
+  const char* name;
+  float* value;
+};
+
+entry registry[] = {
+  {"maxAge", &Drop::maxAge},
+  {"minVol", &Drop::minVol},
+  {"evapRate", &Drop::evapRate},
+  {"depositionRate", &Drop::depositionRate},
+  {"entrainment", &Drop::entrainment},
+  {"gravity", &Drop::gravity},
+  {"momentumTransfer", &Drop::momentumTransfer},
+  {"lrate", &World::lrate},
+  {"maxdiff", &World::maxdiff},
+  {"settling", &World::settling},
+  {"maxSize", &Plant::maxSize},
+  {"growRate", &Plant::growRate},
+  {"maxSteep", &Plant::maxSteep},
+  {"maxDischarge", &Plant::maxDischarge},
+  {"maxTreeHeight", &Plant::maxTreeHeight},
+  {"maxNeighbors", &Plant::maxNeighbors},
+  {"meanAge", &Plant::meanAge},
+  {"spawnRate", &Plant::spawnRate}
+};
+
+float* find(const std::string& name){
+  for(auto& e: registry)
+  if(name == e.name)
+    return e.value;
+  return NULL;
+}
+
+}; // namespace param
+
+#endif
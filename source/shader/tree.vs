@@ -2,7 +2,7 @@
 
 layout(location = 0) in vec4 in_Pos;
 layout(location = 1) in vec3 in_Normal;
-layout(location = 2) in mat4 in_Model;
+layout(location = 2) in vec4 in_Tree;      //Translation (xyz), Scale (w)
 
 uniform mat4 proj;
 uniform mat4 view;
@@ -12,9 +12,9 @@ out vec3 ex_Normal;
 
 void main(void) {
 
-	const vec4 v_Position = view * in_Model * in_Pos;
+	const vec4 v_Position = view * vec4(in_Tree.xyz + in_Tree.w*in_Pos.xyz, 1.0);
 	ex_Position = v_Position;
-	ex_Normal = transpose(inverse(mat3(view * in_Model))) * normalize(in_Normal);
+	ex_Normal = mat3(view) * normalize(in_Normal) / in_Tree.w;	//Uniform Scale: Inverse Transpose
 	gl_Position = proj*v_Position;
 
 }
@@ -2,12 +2,12 @@
 
 layout(location = 0) in vec4 in_Pos;
 layout(location = 1) in vec3 in_Normal;
-layout(location = 2) in mat4 in_Model;
+layout(location = 2) in vec4 in_Tree;      //Translation (xyz), Scale (w)
 
 uniform mat4 dvp;
 
 void main(){
 
-  gl_Position = dvp*in_Model*in_Pos;
+  gl_Position = dvp*vec4(in_Tree.xyz + in_Tree.w*in_Pos.xyz, 1.0);
 
 }
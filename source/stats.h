@@ -0,0 +1,207 @@
+#ifndef SIMPLEHYDROLOGY_STATS
+#define SIMPLEHYDROLOGY_STATS
+
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+SimpleHydrology - stats.h
+
+Hot-path counters and per-phase timers, enabled by compiling
+with -DHYDROLOGY_STATS. Otherwise count() and timer are empty
+and compile out.
+
+Counters are accumulated per thread (no shared cache lines or
+atomics in the hot path), and summed once per frame. frame() must
+be called outside of the parallel erosion, where the worker pool
+has synchronized with the main thread. Every frame appends the
+counts and phase times of that frame to a CSV log.
+*/
+
+namespace stats {
+
+enum counter {
+  SPAWNED,            // Drops Spawned
+  REJECTED,           // Drop Spawns Rejected (Height < 0.1)
+  DIED_AGE,           // Drop Terminations
+  DIED_VOLUME,
+  DIED_OOB,
+  AGE,                // Sum of Drop Age at Termination
+  TRANSFERS,          // Cascade Transfers
+  BORN,               // Plants Born
+  DIED,               // Plants Died
+  COUNTERS
+};
+
+enum phase {
+  ERODE,
+  GROW,
+  MESH,               // updatenode
+  TREES,              // Tree Instance Rebuild
+  UPLOAD,             // Texture Upload
+  PHASES
+};
+
+const char* counternames[] = {
+  "spawned", "rejected", "died_age", "died_volume", "died_oob", "age", "transfers", "born", "died"
+};
+
+const char* phasenames[] = {
+  "erode", "grow", "mesh", "trees", "upload"
+};
+
+#ifdef HYDROLOGY_STATS
+
+// Per-Thread Counters
+
+struct local;
+
+std::mutex m;
+std::vector<local*> threads;
+uint64_t retired[COUNTERS] = {};
+
+struct local {
+
+  uint64_t v[COUNTERS] = {};
+
+  local(){
+    std::lock_guard<std::mutex> lock(m);
+    threads.push_back(this);
+  }
+
+  ~local(){
+    std::lock_guard<std::mutex> lock(m);
+    for(int c = 0; c < COUNTERS; c++)
+      retired[c] += v[c];
+    threads.erase(std::find(threads.begin(), threads.end(), this));
+  }
+
+};
+
+// Counters of the Thread (Plain Pointer: No TLS Initialization Guard),
+//  owned by a Holder which retires them when the Thread exits.
+
+thread_local local* counts = NULL;
+
+struct holder {
+  local* l = NULL;
+  ~holder(){ delete l; }
+};
+
+thread_local holder owner;
+
+__attribute__((noinline, cold)) local* attach(){
+  owner.l = new local();
+  return counts = owner.l;
+}
+
+#endif
+
+inline void count(const counter c, const uint64_t n = 1){
+  #ifdef HYDROLOGY_STATS
+  local* l = counts;
+  if(l == NULL) l = attach();
+  l->v[c] += n;
+  #endif
+}
+
+// Phase Timer (Scoped, Main Thread)
+
+double elapsed[PHASES] = {};   // Seconds in the Current Frame
+
+struct timer {
+
+  #ifdef HYDROLOGY_STATS
+  const phase p;
+  const std::chrono::steady_clock::time_point start;
+  timer(const phase _p):p(_p),start(std::chrono::steady_clock::now()){}
+  ~timer(){
+    elapsed[p] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  #else
+  timer(const phase){}
+  #endif
+
+};
+
+// Frame Summary
+
+unsigned int frames = 0;
+uint64_t total[COUNTERS] = {};    // Totals at the End of the Last Frame
+uint64_t last[COUNTERS] = {};     // Counts of the Last Frame
+double lastelapsed[PHASES] = {};  // Phase Times of the Last Frame
+
+std::ofstream file;
+
+bool open(const std::string& path){
+
+  #ifdef HYDROLOGY_STATS
+  file.open(path);
+  if(!file.is_open())
+    return false;
+
+  file<<"frame";
+  for(auto& name: counternames)
+    file<<","<<name;
+  for(auto& name: phasenames)
+    file<<","<<name;
+  file<<"\n";
+  #endif
+
+  return true;
+
+}
+
+void frame(){
+
+  #ifdef HYDROLOGY_STATS
+
+  uint64_t now[COUNTERS];
+  {
+    std::lock_guard<std::mutex> lock(m);
+    for(int c = 0; c < COUNTERS; c++){
+      now[c] = retired[c];
+      for(auto& t: threads)
+        now[c] += t->v[c];
+    }
+  }
+
+  for(int c = 0; c < COUNTERS; c++){
+    last[c] = now[c] - total[c];
+    total[c] = now[c];
+  }
+
+  for(int p = 0; p < PHASES; p++){
+    lastelapsed[p] = elapsed[p];
+    elapsed[p] = 0.0;
+  }
+
+  if(file.is_open()){
+    file<<frames;
+    for(auto& c: last)
+      file<<","<<c;
+    for(auto& t: lastelapsed)
+      file<<","<<1000.0*t;
+    file<<"\n";
+  }
+
+  #endif
+
+  frames++;
+
+}
+
+// Mean Age of the Drops Terminated in the Last Frame
+
+double meanage(){
+  const uint64_t n = last[DIED_AGE] + last[DIED_VOLUME] + last[DIED_OOB];
+  return (n > 0) ? (double)last[AGE]/n : 0.0;
+}
+
+}; // namespace stats
+
+#endif
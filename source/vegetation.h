@@ -17,6 +17,7 @@ struct Plant {
 
   glm::vec2 pos;
   float size = 0.0;
+  unsigned int death = UINT_MAX;    // Vegetation::tick of Death (Mortality)
 
   // Parameters
 
@@ -25,12 +26,16 @@ struct Plant {
   static float maxSteep;
   static float maxDischarge;
   static float maxTreeHeight;
+  static float maxNeighbors;
+  static float meanAge;
+  static float spawnRate;
 
   // Update Functions
 
   void root(float factor);
   void grow();
   static bool spawn(vec2 pos);
+  static unsigned int lifetime(rng::counter& r);
   bool die();
 
 };
@@ -40,17 +45,167 @@ float Plant::growRate = 0.05f;
 float Plant::maxSteep = 0.8f;
 float Plant::maxDischarge = 0.3f;
 float Plant::maxTreeHeight = 0.8f;
+float Plant::maxNeighbors = 0.0f;       // Max. Plants near a Seed (0: No Limit)
+float Plant::meanAge = 1000.0f;         // Mean Lifetime (Ticks)
+float Plant::spawnRate = 1.0f;          // Random Seeding Attempts per Tick (Whole Map)
+
+// Hazard Bitmap: One Bit per Cell (Indexed as the Cellpool), set where
+//  plants can't live (discharge or height above the plant thresholds).
+//  It is updated in the field update of the erosion, which records the
+//  cells that became hazardous, so that only plants on these cells have
+//  to be checked for death (see Vegetation::grow).
+
+
+struct Hazard {
+
+  std::vector<uint64_t> bits;
+  std::vector<std::vector<ivec2>> crossed;    // Positions of New Hazard Cells, per Chunk
+  size_t chunk = 4096;                        // Cells per Chunk
+  bool full = true;                           // Bits were Reset: Check all Plants
+
+  float maxDischarge = -1.0f;                 // Plant Parameters of the Bits
+  float maxTreeHeight = -1.0f;
+  float discharge = 0.0f;                     // Raw Discharge Threshold
+
+  void prepare(const size_t cells, const size_t per);
+  static float threshold(const float maxDischarge);
+
+  // Chunks can be smaller than a word (coarse levels of detail), so the
+  //  bits are changed atomically. Each bit is only written by its chunk.
+
+  inline void update(const size_t i, const ivec2 pos, const float d, const float h){
+    const uint64_t b = uint64_t(1) << (i & 63);
+    const bool hazard = (d >= discharge) | (h >= maxTreeHeight);
+    std::atomic_ref<uint64_t> w(bits[i >> 6]);
+    const bool set = (w.load(std::memory_order_relaxed) & b) != 0;
+    if(__builtin_expect(hazard == set, 1))
+      return;
+    if(hazard){
+      w.fetch_or(b, std::memory_order_relaxed);
+      crossed[i/chunk].push_back(pos);
+    }
+    else w.fetch_and(~b, std::memory_order_relaxed);
+  }
+
+};
+
+// Eligibility Bitmap: One Bit per Cell, set where a plant can be seeded (see
+//  Plant::spawn). Nodes are in cellpool order, the cells of a node in row-
+//  major order for every cell layout, so the seeds don't depend on it. It
+//  is recomputed before seeding when the fields changed (on the erosion
+//  workers, if any), and the seeds are drawn uniformly from the set bits.
+
+struct Eligible {
+
+  std::vector<uint64_t> bits;
+  std::vector<size_t> count;                  // Set Bits before each Chunk
+  size_t chunk = 4096;                        // Cells per Chunk
+
+  unsigned int cycle = UINT_MAX;              // World::cycle of the Bits
+  vec3 params = vec3(-1);                     // Plant Parameters of the Bits
+
+  static bool flat(quad::node& node, const ivec2 l);
+  static uint64_t row(quad::node& node, const size_t j);
+  void update(const Hazard& hazard);
+  inline size_t size() const { return count.empty() ? 0 : count.back(); }
+  ivec2 pick(size_t n) const;                 // Position of the n-th Set Bit
+
+};
+
+// Plant Grid: Uniform Grid of Plant Handles, for Position Queries
+//  Every bucket covers cellsize x cellsize cells of the map, and holds
+//  the handles of the plants inside it (in no particular order).
+
+struct PlantGrid {
+
+  static const int cellsize = 16;
+
+  ivec2 res = ivec2(0);                               // Buckets per Axis
+  std::vector<std::vector<slotmap::handle>> buckets;
+
+  void resize(const ivec2 mapres){
+    res = (mapres + cellsize - 1)/cellsize;
+    buckets.assign(res.x*res.y, {});
+  }
+
+  inline ivec2 bucket(const vec2 pos) const {
+    return glm::clamp(ivec2(pos)/cellsize, ivec2(0), res - 1);
+  }
+
+  inline std::vector<slotmap::handle>& at(const ivec2 b){
+    return buckets[b.y*res.x + b.x];
+  }
+
+  void insert(const slotmap::handle h, const vec2 pos){
+    at(bucket(pos)).push_back(h);
+  }
+
+  void erase(const slotmap::handle h, const vec2 pos){
+    std::vector<slotmap::handle>& b = at(bucket(pos));
+    for(auto& e: b)
+    if(e.slot == h.slot){
+      e = b.back();
+      b.pop_back();
+      return;
+    }
+  }
+
+  // Queries: f(Plant&) for every Plant in the Region
+
+  template<typename F> void rect(const vec2 min, const vec2 max, F f);
+  template<typename F> void near(const vec2 pos, const float radius, F f);
+  template<typename F> void frustum(const glm::mat4& vp, F f);
+  size_t count(const vec2 pos, const float radius);
+
+};
 
 // Vegetation Struct (Plant Container)
+//  Plants are stored densely and removed by swapping, so the
+//  plant order changes when a plant dies. The number of plants
+//  is bounded by plants.capacity (no births when full).
+//  Plants must be added and removed through add / remove,
+//  which keep the grid index up to date. Births, deaths (the
+//  dense slots they change) and growth are marked in changed,
+//  for the renderer's tree instances.
 
 struct Vegetation {
 
-  static std::vector<Plant> plants;
+  static slotmap::map<Plant> plants;
+  static PlantGrid grid;
+  static Hazard hazard;
+  static Eligible eligible;
+  static unsigned int tick;                   // Growth Cycle Counter
+
+  struct mortal {
+    unsigned int death;
+    slotmap::handle h;
+    bool operator>(const mortal& o) const { return death > o.death; }
+  };
+
+  static std::vector<mortal> deaths;          // Min-Heap of Plant Deaths
+  static std::vector<uint64_t> changed;       // Changed Plants (Bitmap of Dense Indices)
+
+  static inline void change(const size_t i){
+    if(i/64 >= changed.size())
+      changed.resize(i/64 + 1, 0);
+    changed[i/64] |= uint64_t(1) << (i%64);
+  }
+
+  static slotmap::handle add(const vec2 pos, const unsigned int death = UINT_MAX);
+  static void remove(const size_t i);
+  static void assign(const Plant* first, const Plant* last);
+  static void clear();
   static bool grow();
 
 };
 
-std::vector<Plant> Vegetation::plants;
+slotmap::map<Plant> Vegetation::plants = { (1 << 20) };
+PlantGrid Vegetation::grid;
+Hazard Vegetation::hazard;
+Eligible Vegetation::eligible;
+std::vector<Vegetation::mortal> Vegetation::deaths;
+std::vector<uint64_t> Vegetation::changed;
+unsigned int Vegetation::tick = 0;
 
 /*
 ================================================================================
@@ -68,11 +223,18 @@ bool Plant::die(){
 
   if( World::map.discharge(pos) >= Plant::maxDischarge ) return true;
   if( World::map.height(pos) >= Plant::maxTreeHeight) return true;
-  if( rand()%1000 == 0 ) return true;
   return false;
 
 }
 
+// Geometric Lifetime (Ticks >= 1): Every Tick, a Plant dies with
+//  Probability 1 / meanAge, so the Death Tick is sampled at Birth.
+
+unsigned int Plant::lifetime(rng::counter& r){
+  const double n = 1.0 + std::log(1.0 - r.uniform())/std::log(1.0 - 1.0/std::max(Plant::meanAge, 1.0f));
+  return (n < (double)(UINT_MAX/2)) ? (unsigned int)n : UINT_MAX/2;
+}
+
 bool Plant::spawn( vec2 pos ){
 
   if( World::map.discharge(pos) >= Plant::maxDischarge ) return false;
@@ -86,82 +248,505 @@ bool Plant::spawn( vec2 pos ){
 
 void Plant::root(float f){
 
-  quad::cell* c;
+  // Root Density is Marked as Written (Checkpoint Deltas)
+
+  auto add = [&](const vec2 d, const float w){
+    quad::cellptr c = World::map.getCell(pos + d);
+    if(c == NULL) return;
+    c->rootdensity += f*w;
+    World::map.mark(c);
+  };
+
+  add(vec2( 0, 0), 1.0f);
+
+  add(vec2( 1, 0), 0.6f);
+  add(vec2(-1, 0), 0.6f);
+  add(vec2( 0, 1), 0.6f);
+  add(vec2( 0,-1), 0.6f);
+
+  add(vec2(-1,-1), 0.4f);
+  add(vec2( 1,-1), 0.4f);
+  add(vec2(-1, 1), 0.4f);
+  add(vec2( 1, 1), 0.4f);
+
+}
+
+// Grid Queries
+
+template<typename F>
+void PlantGrid::rect(const vec2 min, const vec2 max, F f){
+
+  if(buckets.empty())
+    return;
+
+  const ivec2 a = bucket(min);
+  const ivec2 b = bucket(max);
+
+  for(int x = a.x; x <= b.x; x++)
+  for(int y = a.y; y <= b.y; y++)
+  for(auto& h: at(ivec2(x, y))){
+    Plant* p = Vegetation::plants.get(h);
+    if(p == NULL) continue;
+    if(p->pos.x < min.x || p->pos.y < min.y) continue;
+    if(p->pos.x > max.x || p->pos.y > max.y) continue;
+    f(*p);
+  }
+
+}
+
+template<typename F>
+void PlantGrid::near(const vec2 pos, const float radius, F f){
+  rect(pos - radius, pos + radius, [&](Plant& p){
+    const vec2 d = p.pos - pos;
+    if(dot(d, d) <= radius*radius)
+      f(p);
+  });
+}
+
+// Plants in the Buckets inside the View Frustum of the View-Projection Matrix
+//  (World Space as Rendered: x, height, y)
+
+template<typename F>
+void PlantGrid::frustum(const glm::mat4& vp, F f){
+
+  // Frustum Planes (Gribb / Hartmann)
+
+  auto row = [&](const int i){
+    return glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+  };
+
+  glm::vec4 planes[6];
+  for(int i = 0; i < 3; i++){
+    planes[2*i+0] = row(3) + row(i);
+    planes[2*i+1] = row(3) - row(i);
+  }
+
+  const float top = quad::mapscale + 2.0f*Plant::maxSize;
+
+  for(int x = 0; x < res.x; x++)
+  for(int y = 0; y < res.y; y++){
+
+    // Bucket Bounding Box against every Plane (Positive Vertex)
+
+    const vec3 lo = vec3(x*cellsize, 0, y*cellsize);
+    const vec3 hi = vec3((x+1)*cellsize, top, (y+1)*cellsize);
+
+    bool inside = true;
+    for(auto& p: planes){
+      const vec3 v = vec3(p.x > 0 ? hi.x : lo.x, p.y > 0 ? hi.y : lo.y, p.z > 0 ? hi.z : lo.z);
+      if(p.x*v.x + p.y*v.y + p.z*v.z + p.w < 0){
+        inside = false;
+        break;
+      }
+    }
+
+    if(!inside)
+      continue;
+
+    for(auto& h: at(ivec2(x, y))){
+      Plant* p = Vegetation::plants.get(h);
+      if(p != NULL) f(*p);
+    }
+
+  }
+
+}
+
+size_t PlantGrid::count(const vec2 pos, const float radius){
+  size_t n = 0;
+  near(pos, radius, [&](Plant&){ n++; });
+  return n;
+}
+
+// Hazard Bitmap Methods
+
+// Resize the Bitmap (Cells, Cells per Node) before a Field Update. If the
+//  plant parameters changed, the thresholds are recomputed and all bits
+//  are set, so the field update records no crossings and all plants are
+//  checked instead.
+
+void Hazard::prepare(const size_t cells, const size_t per){
+
+  chunk = (per < 4096) ? per : 4096;
+
+  if(bits.size() != (cells + 63)/64 || maxDischarge != Plant::maxDischarge || maxTreeHeight != Plant::maxTreeHeight){
+
+    bits.assign((cells + 63)/64, ~uint64_t(0));
+    full = true;
+    maxDischarge = Plant::maxDischarge;
+    maxTreeHeight = Plant::maxTreeHeight;
+
+    discharge = threshold(maxDischarge);
+
+  }
+
+  crossed.resize(cells/chunk);
+
+}
+
+// Smallest Raw Discharge d with erf(0.4 d) >= t (Bisection)
+
+float Hazard::threshold(const float t){
+
+  float lo = 0.0f, hi = 1E6f;
+  if(erf(0.4f*hi) < t)
+    return INFINITY;
+
+  while(std::nextafter(lo, hi) < hi){
+    const float mid = 0.5f*(lo + hi);
+    if(erf(0.4f*mid) >= t) hi = mid;
+    else lo = mid;
+  }
+
+  return (erf(0.4f*lo) >= t) ? lo : hi;
+
+}
+
+// Eligibility Bitmap Methods
+
+// Slope Test of a Cell (Local Position in the Node) on the Heights:
+//  The y-component of the summed plane normals of quad::_normal is
+//  the number of planes k, so n.y >= maxSteep is tested without the
+//  normalization. (The result can differ from Plant::spawn in the
+//  last bit, which is why seeds are checked again.)
+
+bool Eligible::flat(quad::node& node, const ivec2 l){
 
-  c = World::map.getCell( pos + vec2( 0, 0) );
-  if(c != NULL) c->rootdensity += f*1.0f;
+  const ivec2 res = node.s.res;
+  float nx = 0.0f, nz = 0.0f, k = 0.0f;
 
-  c = World::map.getCell( pos + vec2( 1, 0) );
-  if(c != NULL) c->rootdensity += f*0.6f;
+  // Interior Fast-Path: All Four Planes, No Bounds Checks
 
-  c = World::map.getCell( pos + vec2(-1, 0) );
-  if(c != NULL) c->rootdensity += f*0.6f;
+  if(l.x >= 1 && l.y >= 1 && l.x < res.x - 1 && l.y < res.y - 1){
 
-  c = World::map.getCell( pos + vec2( 0, 1) );
-  if(c != NULL) c->rootdensity += f*0.6f;
+    auto height = [&](const ivec2 q){
+      return (node.s.root.start + math::cflatten(q, res))->height;
+    };
 
-  c = World::map.getCell( pos + vec2( 0,-1) );
-  if(c != NULL) c->rootdensity += f*0.6f;
+    const float h = height(l);
+    const float dxp = quad::mapscale*(height(l + ivec2(1, 0)) - h);
+    const float dxm = quad::mapscale*(height(l - ivec2(1, 0)) - h);
+    const float dyp = quad::mapscale*(height(l + ivec2(0, 1)) - h);
+    const float dym = quad::mapscale*(height(l - ivec2(0, 1)) - h);
 
-  c = World::map.getCell( pos + vec2(-1,-1) );
-  if(c != NULL) c->rootdensity += f*0.4f;
+    nx = 2.0f*(dxm - dxp);
+    nz = 2.0f*(dym - dyp);
+    k = 4.0f;
 
-  c = World::map.getCell( pos + vec2( 1,-1) );
-  if(c != NULL) c->rootdensity += f*0.4f;
+  }
+
+  else {
+
+    const ivec2 p = node.pos + quad::lodsize*l;
+    const int d = quad::lodsize;
+    const float h = World::map.height(p);
+
+    const bool px = p.x + d < quad::res.x, mx = p.x - d >= 0;
+    const bool py = p.y + d < quad::res.y, my = p.y - d >= 0;
+
+    const float dxp = px ? quad::mapscale*(World::map.height(p + ivec2(d, 0)) - h) : 0.0f;
+    const float dxm = mx ? quad::mapscale*(World::map.height(p - ivec2(d, 0)) - h) : 0.0f;
+    const float dyp = py ? quad::mapscale*(World::map.height(p + ivec2(0, d)) - h) : 0.0f;
+    const float dym = my ? quad::mapscale*(World::map.height(p - ivec2(0, d)) - h) : 0.0f;
+
+    if(px && py){ nx -= dxp; nz -= dyp; k++; }
+    if(mx && my){ nx += dxm; nz += dym; k++; }
+    if(px && my){ nx -= dxp; nz += dym; k++; }
+    if(mx && py){ nx += dxm; nz -= dyp; k++; }
+
+  }
+
+  if(Plant::maxSteep <= 0.0f)
+    return true;
+  return k*k >= Plant::maxSteep*Plant::maxSteep*(nx*nx + k*k + nz*nz);
+
+}
+
+// Slope Test of 64 Cells in a Row (Row-Major Layout, from Local Index j),
+//  as flat() for Interior Cells. The cells at the y-border of the node are
+//  not valid and have to be tested with flat().
+
+uint64_t Eligible::row(quad::node& node, const size_t j){
+
+  if(Plant::maxSteep <= 0.0f)
+    return ~uint64_t(0);
+
+  const size_t n = node.s.res.y;
+  const float s2 = Plant::maxSteep*Plant::maxSteep;
+  const quad::cellptr c = node.s.root.start;
+
+  uint64_t f = 0;
+  for(int b = 0; b < 64; b++){
+
+    const size_t i = j + b;
+    const float h = (c + i)->height;
+    const float dxp = quad::mapscale*((c + (i + n))->height - h);
+    const float dxm = quad::mapscale*((c + (i - n))->height - h);
+    const float dyp = quad::mapscale*((c + (i + 1))->height - h);
+    const float dym = quad::mapscale*((c + (i - 1))->height - h);
+
+    const float nx = 2.0f*(dxm - dxp);
+    const float nz = 2.0f*(dym - dyp);
+    f |= uint64_t(16.0f >= s2*(nx*nx + 16.0f + nz*nz)) << b;
+
+  }
+
+  return f;
+
+}
+
+// Recompute the Bits if the Fields or Plant Parameters changed:
+//  The discharge and height conditions are the clear bits of the
+//  hazard bitmap (computed in the field update), the slope is
+//  only tested for the remaining cells.
+
+void Eligible::update(const Hazard& hazard){
+
+  const vec3 p = vec3(hazard.maxDischarge, hazard.maxTreeHeight, Plant::maxSteep);
+  if(cycle == World::cycle && params == p && bits.size() == hazard.bits.size())
+    return;
+
+  cycle = World::cycle;
+  params = p;
+  chunk = hazard.chunk;
+  bits.resize(hazard.bits.size());
+  count.resize(bits.size()*64/chunk + 1);
+
+  const size_t per = quad::tilearea/quad::lodarea;
+
+  auto pass = [&](const size_t k, const int t){
+
+    const size_t first = k*chunk;
+    quad::node& node = World::map.nodes[first/per];
+    size_t n = 0;
+
+    for(size_t w = first/64; w < (first + chunk)/64; w++){
+
+      #if !defined(HYDROLOGY_MORTON) && !defined(HYDROLOGY_BLOCKED)
+
+      // Row-Major Layout: The Word is a Run of 64 Cells along y
+
+      uint64_t m = ~hazard.bits[w];
+      uint64_t test = m;
+
+      const size_t j = (64*w)%per;
+      const ivec2 res = node.s.res;
+      if(m != 0 && res.y%64 == 0 && j/res.y >= 1 && j/res.y < (size_t)res.x - 1){
+        const uint64_t border = ((j%res.y == 0) ? uint64_t(1) : 0) | ((j%res.y + 64 == (size_t)res.y) ? uint64_t(1) << 63 : 0);
+        m &= row(node, j) | border;
+        test = m & border;
+      }
+
+      #else
+
+      // Other Layouts: Gather the Hazard Bits of the Word's Cells
+
+      const size_t base = first - first%per;
+      uint64_t m = 0;
+      for(int b = 0; b < 64; b++){
+        const ivec2 l = math::unflatten((64*w + b)%per, quad::tileres/quad::lodsize);
+        const size_t i = base + math::cflatten(l, quad::tileres/quad::lodsize);
+        m |= (~hazard.bits[i/64] >> (i%64) & 1) << b;
+      }
+      uint64_t test = m;
+
+      #endif
+
+      for(uint64_t r = test; r != 0; r &= r - 1){
+        const int b = __builtin_ctzll(r);
+        if(!flat(node, math::unflatten((64*w + b)%per, quad::tileres/quad::lodsize)))
+          m &= ~(uint64_t(1) << b);
+      }
+
+      bits[w] = m;
+      n += __builtin_popcountll(m);
+
+    }
+
+    count[k + 1] = n;
+    World::map.touch(&node);
+
+  };
+
+  World::workers.foreach(bits.size()*64/chunk, pass);
+
+  World::map.page();
+
+  count[0] = 0;
+  for(size_t k = 1; k < count.size(); k++)
+    count[k] += count[k - 1];
 
-  c = World::map.getCell( pos + vec2(-1, 1) );
-  if(c != NULL) c->rootdensity += f*0.4f;
+}
+
+ivec2 Eligible::pick(size_t n) const {
+
+  const size_t per = quad::tilearea/quad::lodarea;
+  const size_t k = std::upper_bound(count.begin(), count.end(), n) - count.begin() - 1;
+  n -= count[k];
 
-  c = World::map.getCell( pos + vec2( 1, 1) );
-  if(c != NULL) c->rootdensity += f*0.4f;
+  size_t w = k*chunk/64;
+  while(n >= (size_t)__builtin_popcountll(bits[w]))
+    n -= __builtin_popcountll(bits[w++]);
+
+  uint64_t m = bits[w];
+  for(; n > 0; n--)
+    m &= m - 1;
+
+  const size_t i = 64*w + __builtin_ctzll(m);
+  return World::map.nodes[i/per].pos + quad::lodsize*math::unflatten(i%per, quad::tileres/quad::lodsize);
 
 }
 
 // Vegetation Specific Methods
 
+slotmap::handle Vegetation::add(const vec2 pos, const unsigned int death){
+
+  if(grid.res != (quad::res + PlantGrid::cellsize - 1)/PlantGrid::cellsize)
+    grid.resize(quad::res);
+
+  const slotmap::handle h = plants.insert(pos);
+  if(!h.valid())
+    return h;
+
+  grid.insert(h, pos);
+  plants.back().death = death;
+  change(plants.size() - 1);
+
+  if(death != UINT_MAX){
+    deaths.push_back({death, h});
+    std::push_heap(deaths.begin(), deaths.end(), std::greater<mortal>());
+  }
+
+  return h;
+
+}
+
+void Vegetation::remove(const size_t i){
+  grid.erase(plants.at(i), plants[i].pos);
+  plants.erase(i);
+  if(i < plants.size())
+    change(i);
+}
+
+void Vegetation::assign(const Plant* first, const Plant* last){
+  clear();
+  for(const Plant* p = first; p != last; p++)
+  if(add(p->pos, p->death).valid())
+    plants.back() = *p;
+}
+
+void Vegetation::clear(){
+  plants.clear();
+  deaths.clear();
+  changed.clear();
+  grid.resize(quad::res);
+  for(auto& c: hazard.crossed)
+    c.clear();
+}
+
+/*
+  Plant Deaths are Event-Driven: A plant dies when its cell becomes
+  hazardous (recorded by the field update, see Hazard), or when its
+  sampled lifetime ends (heap of death ticks). Surviving plants never
+  sit on hazard cells, so no other plant has to be checked.
+
+  The dying plants are removed in descending dense order, so that the
+  resulting plant order only depends on the set of deaths. If the bitmap
+  was reset, or the plant thresholds changed since the last field update,
+  all plants are checked.
+*/
+
 bool Vegetation::grow(){
 
-  //Random Position
-  {
+  stats::timer timer(stats::GROW);
 
-    int x = rand()%(quad::res.x);
-    int y = rand()%(quad::res.y);
+  // Collect Dead Plants (Dense Index)
 
-    if( Plant::spawn(vec2(x, y)) ){
+  std::vector<size_t> dead;
 
-      plants.emplace_back(vec2(x, y));
-      plants.back().root(1.0);
+  if(hazard.full || hazard.maxDischarge != Plant::maxDischarge || hazard.maxTreeHeight != Plant::maxTreeHeight){
+    for(size_t i = 0; i < plants.size(); i++)
+    if(plants[i].die())
+      dead.push_back(i);
+    hazard.full = false;
+  }
 
-    }
+  for(auto& c: hazard.crossed){
+    for(auto& pos: c)
+    grid.rect(vec2(pos), vec2(pos + quad::lodsize - 1), [&](Plant& p){
+      if(p.die())
+        dead.push_back(&p - plants.data());
+    });
+    c.clear();
+  }
 
+  while(!deaths.empty() && deaths.front().death <= tick){
+    std::pop_heap(deaths.begin(), deaths.end(), std::greater<mortal>());
+    Plant* p = plants.get(deaths.back().h);
+    if(p != NULL)
+      dead.push_back(p - plants.data());
+    deaths.pop_back();
   }
 
-  // Iterate over Plants
+  std::sort(dead.begin(), dead.end(), std::greater<size_t>());
+  dead.erase(std::unique(dead.begin(), dead.end()), dead.end());
 
-  for(int i = 0; i < plants.size(); i++){
+  for(auto& i: dead){
+    plants[i].root(-1.0);
+    remove(i);
+    stats::count(stats::DIED);
+  }
 
-    //Grow the Plant
+  // Random Seeds on Eligible Cells: spawnRate Attempts at Uniform Cells
+  //  per Tick would Succeed on the Eligible Fraction of the Cells, which
+  //  is the Expected Number of Seeds.
 
-    plants[i].grow();
+  if(Plant::spawnRate > 0){
+
+    rng::counter r(World::SEED, rng::VEGETATION, tick, 0);
+    eligible.update(hazard);
+
+    const float rate = Plant::spawnRate*(float)eligible.size()/(float)(eligible.bits.size()*64);
+    int n = (int)rate;
+    if(r.uniform() < rate - n)
+      n++;
 
-    // Check for Kill Plant
+    for(; n > 0 && eligible.size() > 0 && !plants.full(); n--){
 
-    if( plants[i].die() ){
+      const vec2 pos = eligible.pick(r(eligible.size()));
+      if(!Plant::spawn(pos))
+        continue;
 
-       plants[i].root(-1.0);
-       plants.erase(plants.begin()+i);
-       i--;
-       continue;
+      add(pos, tick + Plant::lifetime(r));
+      plants.back().root(1.0);
+      stats::count(stats::BORN);
 
     }
 
+  }
+
+  // Iterate over Plants
+
+  for(size_t i = 0; i < plants.size(); i++){
+
+    rng::counter r(World::SEED, rng::VEGETATION, tick, 1 + i);
+
+    //Grow the Plant
+
+    const float size = plants[i].size;
+    plants[i].grow();
+    if(plants[i].size != size)
+      change(i);
+
     // Check for Growth
 
-    if(rand()%20 != 0)
+    if(r(20) != 0 || plants.full())
       continue;
 
     //Find New Position
-    glm::vec2 npos = plants[i].pos + glm::vec2(rand()%9-4, rand()%9-4);
+    const int dx = r(9)-4;
+    const int dy = r(9)-4;
+    glm::vec2 npos = plants[i].pos + glm::vec2(dx, dy);
 
     //Check for Out-Of-Bounds
     if(World::map.oob(npos))
@@ -170,7 +755,10 @@ bool Vegetation::grow(){
     if(World::map.discharge(npos) >= Plant::maxDischarge)
       continue;
 
-    if((float)(rand()%1000)/1000.0 <= World::map.getCell(npos)->rootdensity)
+    if(World::map.height(npos) >= Plant::maxTreeHeight)
+      continue;
+
+    if((float)r(1000)/1000.0 <= World::map.getCell(npos)->rootdensity)
       continue;
 
     glm::vec3 n = World::map.normal(npos);
@@ -178,11 +766,16 @@ bool Vegetation::grow(){
     if( n.y <= Plant::maxSteep )
       continue;
 
-    plants.emplace_back(npos);
+    if(Plant::maxNeighbors > 0 && grid.count(npos, 4.0f) >= Plant::maxNeighbors)
+      continue;
+
+    add(npos, tick + Plant::lifetime(r));
     plants.back().root(1.0);
+    stats::count(stats::BORN);
 
   }
 
+  tick++;
   return true;
 
 };
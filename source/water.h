@@ -34,7 +34,7 @@ struct Drop {
 
   // Main Methods
 
-  bool descend();
+  template<typename P> bool descend();   // Single Step with Parameter Policy P
 
 };
 
@@ -55,35 +55,50 @@ float Drop::momentumTransfer = 1.0f;
 ================================================================================
 */
 
+template<typename P>
 bool Drop::descend(){
 
   const glm::ivec2 ipos = pos;
 
-  quad::node* node = World::map.get(ipos);
-  if(node == NULL)
-    return false;
+  // Load the 3x3 Neighborhood once
 
-  quad::cell* cell = node->get(ipos);
-  if(cell == NULL)
+  quad::stencil st;
+  if(!st.load(World::map, ipos))
     return false;
 
-  const glm::vec3 n = World::map.normal(ipos);
+  quad::node* node = st.n;
+  quad::cellptr cell = st.c[4];
+
+  // Sediment Cascade of the Previous Step
+
+  if(age > 0)
+    World::cascade<P>(st);
+
+  const glm::vec3 n = st.normal();
 
   // Termination Checks
 
-  if(age > maxAge){
+  if(age > P::maxAge){
+    stats::count(stats::DIED_AGE);
+    stats::count(stats::AGE, age);
     cell->height += sediment;
+    World::map.invalidate(ipos);
+    World::map.mark(cell);
     return false;
   }
 
-  if(volume < minVol){
+  if(volume < P::minVol){
+    stats::count(stats::DIED_VOLUME);
+    stats::count(stats::AGE, age);
     cell->height += sediment;
+    World::map.invalidate(ipos);
+    World::map.mark(cell);
     return false;
   }
 
   // Effective Parameter Set
 
-  float effD = depositionRate*(1.0f - cell->rootdensity);
+  float effD = P::depositionRate*(1.0f - cell->rootdensity);
   if(effD < 0) effD = 0;
 
   // Apply Forces to Particle
@@ -92,11 +107,11 @@ bool Drop::descend(){
 
   //if(cell->height > 0.0){
 
-    speed += quad::lodsize*gravity*vec2(n.x, n.z)/volume;
+    speed += quad::lodsize*P::gravity*vec2(n.x, n.z)/volume;
 
     vec2 fspeed = vec2(cell->momentumx, cell->momentumy);
-    if(length(fspeed) > 0 && length(speed) > 0)
-      speed += quad::lodsize*momentumTransfer*dot(normalize(fspeed), normalize(speed))/(volume + cell->discharge)*fspeed;
+    if(P::momentumTransfer != 0 && length(fspeed) > 0 && length(speed) > 0)
+      speed += quad::lodsize*P::momentumTransfer*dot(normalize(fspeed), normalize(speed))/(volume + cell->discharge)*fspeed;
 
   //}
 
@@ -112,31 +127,42 @@ bool Drop::descend(){
 
   // Update Discharge, Momentum Tracking Maps
 
-  cell->discharge_track += volume;
-  cell->momentumx_track += volume*speed.x;
-  cell->momentumy_track += volume*speed.y;
+  vec3& track = World::trackat(node, cell, ipos);
+  track.x += volume;
+  track.y += volume*speed.x;
+  track.z += volume*speed.y;
 
   //Out-Of-Bounds
   float h2;
-  if(World::map.oob(pos))
+  const glm::ivec2 npos = pos;
+  if(World::map.oob(npos))
     h2 = cell->height-0.002;
-  else
-    h2 = World::map.height(pos);
+  else {
+    const ivec2 d = (npos >> quad::lodshift) - (ipos >> quad::lodshift);
+    if(abs(d.x) <= 1 && abs(d.y) <= 1)
+      h2 = st.h[quad::stencil::index(d.x, d.y)];
+    else
+      h2 = World::map.height(pos);
+  }
 
   //Mass-Transfer (in MASS)
-  float c_eq = (1.0f+entrainment*node->discharge(ipos))*(cell->height-h2);
+  float c_eq = (1.0f+P::entrainment*erf(0.4f*cell->discharge))*(cell->height-h2);
   if(c_eq < 0) c_eq = 0;
   float cdiff = (c_eq - sediment);
 
   sediment += effD*cdiff;
   cell->height -= effD*cdiff;
+  World::map.invalidate(ipos);
+  World::map.mark(cell);
 
   //Evaporate (Mass Conservative)
-  sediment /= (1.0-evapRate);
-  volume *= (1.0-evapRate);
+  sediment /= (1.0-P::evapRate);
+  volume *= (1.0-P::evapRate);
 
   //Out-Of-Bounds
   if(World::map.oob(pos)){
+    stats::count(stats::DIED_OOB);
+    stats::count(stats::AGE, age);
     volume = 0.0;
     return false;
   }
@@ -148,7 +174,8 @@ bool Drop::descend(){
   }
   */
 
-  World::cascade(pos);
+  // Note: The cascade at the new position is done at
+  //  the start of the next step, on its loaded stencil.
 
   age++;
   return true;
@@ -0,0 +1,432 @@
+#ifndef SIMPLEHYDROLOGY_WAVEFRONT
+#define SIMPLEHYDROLOGY_WAVEFRONT
+
+#include <climits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/*
+SimpleHydrology - wavefront.h
+
+Advances a batch of drops in lockstep. The lane state
+is stored as structure-of-arrays, so that the neighborhood
+gather, normal and force computation run over all lanes
+at once (AVX2 gathers if available, scalar otherwise).
+
+Writing back to the map (cascade, tracking, mass transfer)
+is done per lane in lane order, since lanes can touch the
+same cells. As in Drop::descend, the sediment cascade of a
+step is deferred to the start of the next step, before the
+gather, so a lane's physics are those of the serial descent.
+Only the order differs: all lanes of a step see the heights
+from before the step, i.e. a lane doesn't see the erosion of
+the lanes before it, so the output is not the same as that
+of the serial descent and would change with W.
+
+The lane-serial commit costs as much as the gather and the
+compute phase, so W isn't raised to 16 for AVX-512.
+
+Dead drops are replaced by new drops from the queue, or
+compacted out of the wavefront when the queue is empty.
+*/
+
+struct Wavefront {
+
+  static const int W = 8;   // Number of Lanes
+
+  // Lane State
+
+  int n = 0;                // Active Lanes
+
+  int age[W];
+  float px[W], py[W];       // Position
+  float sx[W], sy[W];       // Speed
+  float volume[W];
+  float sediment[W];
+
+  // Gathered Cell Data
+
+  float H[9][W];            // 3x3 Neighborhood Heights
+  int valid[9][W];          // Neighborhood Not Out-Of-Bounds
+  float mx[W], my[W];       // Momentum
+  float discharge[W];
+
+  // Step Results
+
+  bool dead[W];
+  float nx[W], nz[W];       // Normal (x, z)
+
+  // Lane Conversion
+
+  void load(const int l, const Drop& drop){
+    age[l] = drop.age;
+    px[l] = drop.pos.x;
+    py[l] = drop.pos.y;
+    sx[l] = drop.speed.x;
+    sy[l] = drop.speed.y;
+    volume[l] = drop.volume;
+    sediment[l] = drop.sediment;
+  }
+
+  Drop store(const int l) const {
+    Drop drop(vec2(px[l], py[l]));
+    drop.age = age[l];
+    drop.speed = vec2(sx[l], sy[l]);
+    drop.volume = volume[l];
+    drop.sediment = sediment[l];
+    return drop;
+  }
+
+  template<typename P> void cascade();
+  void gather();
+  template<typename P> void compute();
+  template<typename P> void commit();
+
+  // Descend all Drops: Drops for which inside(pos) fails are moved to out.
+
+  template<typename P, typename F>
+  void descend(std::vector<Drop>& drops, F inside, std::vector<Drop>& out);
+
+};
+
+/*
+================================================================================
+                        Cascade Phase (Lane-Serial)
+================================================================================
+*/
+
+// Sediment Cascade of the Previous Step (New Drops have None)
+
+template<typename P>
+void Wavefront::cascade(){
+
+  for(int l = 0; l < n; l++)
+  if(age[l] > 0)
+    World::cascade<P>(vec2(px[l], py[l]));
+
+}
+
+/*
+================================================================================
+                            Gather Phase
+================================================================================
+*/
+
+void Wavefront::gather(){
+
+  quad::map& map = World::map;
+
+  const size_t per = quad::tilearea/quad::lodarea;
+  const ivec2 res = quad::tileres/quad::lodsize;
+
+  int index[9][W] = {};   // Cell Index relative to the first Node
+  bool interior[W];
+
+  // Gather Offsets are 32-Bit: Larger Maps use the Fallback
+
+  const bool direct = (size_t)quad::area/quad::lodarea*(sizeof(quad::cell)/sizeof(float)) < INT_MAX;
+
+  for(int l = 0; l < n; l++){
+
+    const ivec2 ipos = vec2(px[l], py[l]);
+    quad::node* node = map.get(ipos);
+    const ivec2 p = (ipos - node->pos) >> quad::lodshift;
+    map.touch(node);
+
+    interior[l] = direct && (p.x >= 1 && p.y >= 1 && p.x < res.x - 1 && p.y < res.y - 1);
+
+    for(int x = -1; x <= 1; x++)
+    for(int y = -1; y <= 1; y++){
+      const int i = quad::stencil::index(x, y);
+      index[i][l] = (interior[l]) ? (node - map.nodes.data())*per + math::cflatten(p + ivec2(x, y), res) : 0;
+    }
+
+  }
+
+  // Base Pointers and Strides (Elements of the Cell Layout)
+
+  quad::cellptr base = map.nodes[0].s.root.start;
+  float* hbase = &base->height;
+  float* mxbase = &base->momentumx;
+  float* mybase = &base->momentumy;
+  float* dbase = &base->discharge;
+  const int hstride = &(base + 1)->height - hbase;
+  const int fstride = &(base + 1)->discharge - dbase;
+
+  #ifdef __AVX2__
+
+  const __m256i vh = _mm256_set1_epi32(hstride);
+  const __m256i vf = _mm256_set1_epi32(fstride);
+
+  for(int i = 0; i < 9; i++){
+    const __m256i ind = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)index[i]), vh);
+    _mm256_storeu_ps(H[i], _mm256_i32gather_ps(hbase, ind, 4));
+  }
+
+  const __m256i ind = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)index[4]), vf);
+  _mm256_storeu_ps(mx, _mm256_i32gather_ps(mxbase, ind, 4));
+  _mm256_storeu_ps(my, _mm256_i32gather_ps(mybase, ind, 4));
+  _mm256_storeu_ps(discharge, _mm256_i32gather_ps(dbase, ind, 4));
+
+  #else
+
+  for(int i = 0; i < 9; i++)
+  for(int l = 0; l < W; l++)
+    H[i][l] = hbase[index[i][l]*hstride];
+
+  for(int l = 0; l < W; l++){
+    mx[l] = mxbase[index[4][l]*fstride];
+    my[l] = mybase[index[4][l]*fstride];
+    discharge[l] = dbase[index[4][l]*fstride];
+  }
+
+  #endif
+
+  // Lanes at Node Borders: Bounds-Checked Fallback
+
+  for(int l = 0; l < n; l++){
+
+    for(int i = 0; i < 9; i++)
+      valid[i][l] = 1;
+
+    if(interior[l])
+      continue;
+
+    const ivec2 ipos = vec2(px[l], py[l]);
+
+    for(int x = -1; x <= 1; x++)
+    for(int y = -1; y <= 1; y++){
+      const int i = quad::stencil::index(x, y);
+      quad::cellptr c = map.getCell(ipos + quad::lodsize*ivec2(x, y));
+      valid[i][l] = (c != NULL);
+      H[i][l] = (c == NULL) ? 0.0f : c->height;
+    }
+
+    quad::cellptr c = map.getCell(ipos);
+    mx[l] = c->momentumx;
+    my[l] = c->momentumy;
+    discharge[l] = c->discharge;
+
+  }
+
+}
+
+/*
+================================================================================
+                        Compute Phase (Lane-Parallel)
+================================================================================
+  Same as the normal and force computation in Drop::descend,
+  written out per component so that the lane loops vectorize.
+*/
+
+template<typename P>
+void Wavefront::compute(){
+
+  const float S = quad::mapscale;
+
+  for(int l = 0; l < W; l++){
+
+    dead[l] = (age[l] > P::maxAge) || (volume[l] < P::minVol);
+
+    // Surface Normal (Component-Wise Cross Products)
+
+    const float h0 = H[4][l];
+    const float hxp = S*(H[quad::stencil::index( 1, 0)][l] - h0);
+    const float hxn = S*(H[quad::stencil::index(-1, 0)][l] - h0);
+    const float hyp = S*(H[quad::stencil::index( 0, 1)][l] - h0);
+    const float hyn = S*(H[quad::stencil::index( 0,-1)][l] - h0);
+
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+
+    if(valid[quad::stencil::index( 1, 1)][l]){ x += -hxp; y += 1.0f; z += -hyp; }
+    if(valid[quad::stencil::index(-1,-1)][l]){ x +=  hxn; y += 1.0f; z +=  hyn; }
+    if(valid[quad::stencil::index( 1,-1)][l]){ x += -hxp; y += 1.0f; z +=  hyn; }
+    if(valid[quad::stencil::index(-1, 1)][l]){ x +=  hxn; y += 1.0f; z += -hyp; }
+
+    const float len = sqrt(x*x + y*y + z*z);
+    nx[l] = (len > 0) ? x/len : 0.0f;
+    nz[l] = (len > 0) ? z/len : 0.0f;
+
+  }
+
+  for(int l = 0; l < W; l++){
+
+    // Gravity Force
+
+    float vx = sx[l] + quad::lodsize*P::gravity*nx[l]/volume[l];
+    float vy = sy[l] + quad::lodsize*P::gravity*nz[l]/volume[l];
+
+    // Momentum Transfer Force
+
+    const float fl = sqrt(mx[l]*mx[l] + my[l]*my[l]);
+    const float vl = sqrt(vx*vx + vy*vy);
+    if(P::momentumTransfer != 0 && fl > 0 && vl > 0){
+      const float f = quad::lodsize*P::momentumTransfer*((mx[l]*vx + my[l]*vy)/(fl*vl))/(volume[l] + discharge[l]);
+      vx += f*mx[l];
+      vy += f*my[l];
+    }
+
+    // Dynamic Time-Step
+
+    const float sl = sqrt(vx*vx + vy*vy);
+    if(sl > 0){
+      vx = (quad::lodsize*sqrt(2.0f))*vx/sl;
+      vy = (quad::lodsize*sqrt(2.0f))*vy/sl;
+    }
+
+    sx[l] = vx;
+    sy[l] = vy;
+
+  }
+
+}
+
+/*
+================================================================================
+                        Commit Phase (Lane-Serial)
+================================================================================
+*/
+
+template<typename P>
+void Wavefront::commit(){
+
+  quad::map& map = World::map;
+
+  for(int l = 0; l < n; l++){
+
+    const ivec2 ipos = vec2(px[l], py[l]);
+    quad::node* node = map.get(ipos);
+    quad::cellptr cell = node->get(ipos);
+
+    // Termination
+
+    if(dead[l]){
+      stats::count((age[l] > P::maxAge) ? stats::DIED_AGE : stats::DIED_VOLUME);
+      stats::count(stats::AGE, age[l]);
+      cell->height += sediment[l];
+      map.invalidate(ipos);
+      map.mark(cell);
+      continue;
+    }
+
+    const vec2 speed = vec2(sx[l], sy[l]);
+    const vec2 pos = vec2(px[l], py[l]) + speed;
+    px[l] = pos.x;
+    py[l] = pos.y;
+
+    // Update Discharge, Momentum Tracking Maps
+
+    vec3& track = World::trackat(node, cell, ipos);
+    track.x += volume[l];
+    track.y += volume[l]*speed.x;
+    track.z += volume[l]*speed.y;
+
+    // Mass Transfer
+
+    float effD = P::depositionRate*(1.0f - cell->rootdensity);
+    if(effD < 0) effD = 0;
+
+    const bool oob = map.oob(pos);
+    const float h2 = (oob) ? cell->height - 0.002 : map.height(pos);
+
+    float c_eq = (1.0f+P::entrainment*erf(0.4f*cell->discharge))*(cell->height-h2);
+    if(c_eq < 0) c_eq = 0;
+    float cdiff = (c_eq - sediment[l]);
+
+    sediment[l] += effD*cdiff;
+    cell->height -= effD*cdiff;
+    map.invalidate(ipos);
+    map.mark(cell);
+
+    //Evaporate (Mass Conservative)
+    sediment[l] /= (1.0-P::evapRate);
+    volume[l] *= (1.0-P::evapRate);
+
+    if(oob){
+      stats::count(stats::DIED_OOB);
+      stats::count(stats::AGE, age[l]);
+      dead[l] = true;
+      continue;
+    }
+
+    // Note: The cascade at the new position is done in
+    //  the cascade phase of the next step.
+
+    age[l]++;
+
+  }
+
+}
+
+/*
+================================================================================
+                      Wavefront Scheduling / Compaction
+================================================================================
+*/
+
+template<typename P, typename F>
+void Wavefront::descend(std::vector<Drop>& drops, F inside, std::vector<Drop>& out){
+
+  size_t next = 0;
+  n = 0;
+
+  auto fill = [&](){
+
+    for(int l = 0; l < n;){
+
+      const ivec2 ipos = vec2(px[l], py[l]);
+      if(!dead[l] && (World::map.oob(ipos) || inside(ipos))){
+        l++;
+        continue;
+      }
+
+      if(!dead[l])
+        out.push_back(store(l));
+
+      // Refill from the Queue, or Compact
+
+      if(next < drops.size()){
+        load(l, drops[next++]);
+        dead[l] = false;
+        continue;
+      }
+
+      n--;
+      if(l < n){
+        load(l, store(n));
+        dead[l] = dead[n];
+      }
+
+    }
+
+    while(n < W && next < drops.size()){
+      load(n, drops[next++]);
+      dead[n++] = false;
+    }
+
+  };
+
+  for(int l = 0; l < W; l++){
+    dead[l] = false;
+    age[l] = 0;
+    px[l] = py[l] = 0.0f;
+    sx[l] = sy[l] = 0.0f;
+    volume[l] = 1.0f;
+    sediment[l] = 0.0f;
+  }
+
+  fill();
+
+  while(n > 0){
+    cascade<P>();
+    gather();
+    compute<P>();
+    commit<P>();
+    fill();
+  }
+
+}
+
+#endif
@@ -1,10 +1,17 @@
 #ifndef SIMPLEHYDROLOGY_WORLD
 #define SIMPLEHYDROLOGY_WORLD
 
+#include <limits>
+#include <climits>
+
 #include "include/FastNoiseLite.h"
 #include "include/math.h"
+#include "include/parallel.h"
+#include "include/random.h"
+#include "include/slotmap.h"
 
 #include "cellpool.h"
+#include "stats.h"
 
 /*
 SimpleHydrology - world.h
@@ -19,6 +26,8 @@ class World {
 public:
 
   static unsigned int SEED;
+  static unsigned int cycle;                  // Erosion Cycle Counter
+  static float decay;                         // Field Decay Rate (lrate) of the Last Field Update
   static quad::map map;
 
   // Parameters
@@ -28,14 +37,44 @@ public:
   static float maxdiff;
   static float settling;
 
+  // Parallelization
+
+  static int threads;                         // Erosion Worker Threads (0: Serial)
+  static int blocksize;                       // Partitioning Block Size
+  static parallel::pool workers;
+
+  static mappool::pool<vec3> tracks;          // Discharge / Momentum Tracks (Indexed as the Cellpool)
+  static bool localtracks;                    // Per-Block Track Accumulation
+  static thread_local vec3* track;            // Active Block Track Buffer (NULL: tracks)
+  static thread_local ivec2 trackpos;         // Origin of the Active Block
+
+  struct Block;
+  static std::vector<Block> blocks;           // Partitioning Blocks
+  static std::vector<int> colors[4];          // Block Indices by Color
+
+  static bool wavefront;                      // Batched Lockstep Drop Descent
+
   // Main Update Methods
 
-  static void erode(int cycles);              // Erosion Update Step
-  static void cascade(vec2 pos);              // Perform Sediment Cascade
+  static size_t erode(int cycles);            // Erosion Update Step (param::active), Returns #Drops
+  static inline vec3& trackat(quad::node* node, quad::cellptr cell, const ivec2 pos);
+  static void allocate();                     // Allocate the (Zero) Tracks of the Map
+
+  template<typename P> static size_t erode(int cycles);         // Erosion Update Step with Policy P
+  template<typename P> static void cascade(vec2 pos);           // Perform Sediment Cascade
+  template<typename P> static void cascade(quad::stencil& st);  // Sediment Cascade on a Loaded Stencil
+
+private:
+
+  template<typename P> static size_t serial(int cycles);        // Serial Drop Descent
+  template<typename P> static size_t partition(int cycles);     // Partitioned Drop Descent
+  template<typename P> static void reduce();                    // Apply Per-Block Tracks
 
 };
 
 unsigned int World::SEED = 1;
+unsigned int World::cycle = 0;
+float World::decay = -1.0f;
 
 quad::map World::map;
 
@@ -43,106 +82,460 @@ float World::lrate = 0.1f;
 float World::maxdiff = 0.01f;
 float World::settling = 0.8f;
 
+int World::threads = 0;
+int World::blocksize = 64;
+parallel::pool World::workers;
+
+mappool::pool<vec3> World::tracks;
+bool World::localtracks = false;
+thread_local vec3* World::track = NULL;
+thread_local ivec2 World::trackpos = ivec2(0);
+
+bool World::wavefront = false;
+
 #include "vegetation.h"
 #include "water.h"
+#include "param.h"
+#include "wavefront.h"
+
+/*
+  Partitioning Block: Drops queued for the Block and Drops which left it,
+  and the Block's Local Tracks (Row-Major, only Allocated with localtracks)
+*/
+
+struct World::Block {
+  ivec2 pos;
+  std::vector<Drop> in;
+  std::vector<Drop> out;
+  std::vector<vec3> track;
+};
+
+std::vector<World::Block> World::blocks;
+std::vector<int> World::colors[4];
 
 /*
 ===================================================
           HYDRAULIC EROSION FUNCTIONS
 ===================================================
 */
-void World::erode(int cycles){
 
-  for(auto& node: map.nodes)
-  for(auto [cell, pos]: node.s){
-    cell.discharge_track = 0;
-    cell.momentumx_track = 0;
-    cell.momentumy_track = 0;
+size_t World::erode(int cycles){
+
+  stats::timer timer(stats::ERODE);
+
+  switch(param::active){
+    case param::STANDARD: return erode<param::standard>(cycles);
+    case param::NOMOMENTUM: return erode<param::nomomentum>(cycles);
+    default: return erode<param::runtime>(cycles);
+  }
+
+}
+
+// Tracks are Zero outside of the Erosion Step. With Paging, they are
+//  placed in an Anonymous Mapping, and released after the Field Update.
+
+void World::allocate(){
+
+  const size_t cells = map.nodes.size()*(quad::tilearea/quad::lodarea);
+  if(tracks.root.size == cells)
+    return;
+
+  tracks.release();
+  if(map.budget > 0) tracks.reserve(cells, "");
+  else {
+    tracks.reserve(cells);
+    std::fill(tracks.root.start, tracks.root.start + tracks.root.size, vec3(0));
   }
 
+}
+
+// Track of a Cell at World Position pos (Written by the Drops)
+
+inline vec3& World::trackat(quad::node* node, quad::cellptr cell, const ivec2 pos){
+  if(track == NULL)
+    return tracks.root.start[map.index(node, cell)];
+  const ivec2 l = (pos - trackpos) >> quad::lodshift;
+  return track[l.x*(blocksize >> quad::lodshift) + l.y];
+}
+
+template<typename P>
+size_t World::erode(int cycles){
+
+  const bool local = (threads > 0 && localtracks);
+  const size_t per = quad::tilearea/quad::lodarea;
+
+  if(!local)
+    allocate();
+
   //Do a series of iterations!
-  for(auto& node: map.nodes)
+
+  const size_t drops = (threads > 0) ? partition<P>(cycles) : serial<P>(cycles);
+
+  //Update Fields
+
+  // Without a Track, a Cell's Discharge and Momentum only Decay: only
+  //  Tracked Cells are Marked, and all Cells if the Rate changes (see
+  //  checkpoint::chain).
+
+  if(P::lrate != decay){
+    map.mark();
+    decay = P::lrate;
+  }
+
+  Vegetation::hazard.prepare(map.nodes.size()*per, per);
+
+  if(local) reduce<P>();
+  else for(size_t k = 0; k < map.nodes.size(); k++){
+    quad::node& node = map.nodes[k];
+    size_t i = k*per;
+    for(auto [cell, pos]: node.s){
+      vec3& t = tracks.root.start[i];
+      if(t.x != 0.0f || t.y != 0.0f || t.z != 0.0f)
+        map.mark(i);
+      cell.discharge = (1.0f-P::lrate)*cell.discharge + P::lrate*t.x;
+      cell.momentumx = (1.0f-P::lrate)*cell.momentumx + P::lrate*t.y;
+      cell.momentumy = (1.0f-P::lrate)*cell.momentumy + P::lrate*t.z;
+      Vegetation::hazard.update(i++, node.pos + quad::lodsize*pos, cell.discharge, cell.height);
+      t = vec3(0);
+    }
+    if(map.budget > 0)
+      tracks.evict({tracks.root.start + k*per, per});
+    map.touch(&node);
+    map.page();
+  }
+
+  cycle++;
+  return drops;
+
+}
+
+template<typename P>
+size_t World::serial(int cycles){
+
+  size_t drops = 0;
+  std::vector<Drop> batch, out;
+
+  for(auto& node: map.nodes){
   for(int i = 0; i < cycles; i++){
 
     //Spawn New Particle
 
-    glm::vec2 newpos = node.pos + ivec2(rand()%quad::tileres.x, rand()%quad::tileres.y);
+    rng::counter r(SEED, rng::EROSION, cycle, ((uint64_t)(&node - map.nodes.data()) << 32) + i);
+    const int x = r(quad::tileres.x);
+    const int y = r(quad::tileres.y);
+
+    glm::vec2 newpos = node.pos + ivec2(x, y);
+
+    if(node.height(newpos) < 0.1){
+      stats::count(stats::REJECTED);
+      continue;
+    }
+
+    stats::count(stats::SPAWNED);
+    drops++;
 
-    if(node.height(newpos) < 0.1)
+    if(wavefront){
+      batch.emplace_back(newpos);
       continue;
+    }
 
     Drop drop(newpos);
+    while(drop.descend<P>());
 
-    while(drop.descend());
+  }
+  map.page();
+  }
 
+  if(wavefront){
+    Wavefront wf;
+    wf.descend<P>(batch, [](const ivec2){ return true; }, out);
+    map.page();
   }
 
-  //Update Fields
+  return drops;
+
+}
+
+/*
+  Partitioned Descent:
+
+  The map is split into square blocks, which are assigned one of four
+  colors by the parity of their block position. A drop is only advanced
+  while it sits inside its block, and one step reads and writes at most
+  2 cells away from its position (including normal invalidation). Blocks of the same color are one full
+  block apart, so they can be processed concurrently without races.
+
+  Drops which leave their block are handed to the block they moved into,
+  which processes them in a later color phase. Since the hand-off is done
+  serially in block order, the result does not depend on the thread count.
+*/
+
+template<typename P>
+size_t World::partition(int cycles){
+
+  if(workers.size() != threads)
+    workers.init(threads);
+
+  const ivec2 bres = (quad::res + blocksize - 1)/blocksize;
+
+  if(blocks.size() != (size_t)(bres.x*bres.y) || blocks[0].pos != ivec2(0) || blocks.back().pos != blocksize*(bres - 1)){
+    blocks.clear();
+    for(auto& c: colors)
+      c.clear();
+    for(int i = 0; i < bres.x; i++)
+    for(int j = 0; j < bres.y; j++){
+      colors[2*(i%2) + (j%2)].push_back(blocks.size());
+      blocks.push_back({blocksize*ivec2(i, j)});
+    }
+  }
+
+  // Local Tracks: One Buffer per Block, so that every Cell is only ever
+  //  written by its own Block (in the same order as without them)
+
+  const size_t cells = (blocksize >> quad::lodshift)*(blocksize >> quad::lodshift);
+  for(auto& block: blocks){
+    if(!localtracks) std::vector<vec3>().swap(block.track);
+    else if(block.track.size() != cells) block.track.assign(cells, vec3(0));
+  }
+
+  auto index = [&](const ivec2 p){
+    return math::flatten(p/blocksize, bres);
+  };
+
+  //Spawn New Particles into their Blocks
+
+  size_t drops = 0;
+
   for(auto& node: map.nodes)
-  for(auto [cell, pos]: node.s){
-    cell.discharge = (1.0f-lrate)*cell.discharge + lrate*cell.discharge_track;
-    cell.momentumx = (1.0f-lrate)*cell.momentumx + lrate*cell.momentumx_track;
-    cell.momentumy = (1.0f-lrate)*cell.momentumy + lrate*cell.momentumy_track;
+  for(int i = 0; i < cycles; i++){
+
+    rng::counter r(SEED, rng::EROSION, cycle, ((uint64_t)(&node - map.nodes.data()) << 32) + i);
+    const int x = r(quad::tileres.x);
+    const int y = r(quad::tileres.y);
+
+    glm::vec2 newpos = node.pos + ivec2(x, y);
+
+    if(node.height(newpos) < 0.1){
+      stats::count(stats::REJECTED);
+      continue;
+    }
+
+    stats::count(stats::SPAWNED);
+    blocks[index(newpos)].in.emplace_back(newpos);
+    drops++;
+
   }
 
+  size_t active = drops;
+
+  while(active > 0){
+  for(auto& color: colors){
+
+    workers.foreach(color.size(), [&](const size_t i, const int t){
+
+      Block& block = blocks[color[i]];
+      track = localtracks ? block.track.data() : NULL;
+      trackpos = block.pos;
+
+      auto inside = [&](const ivec2 ipos){
+        return ipos.x >= block.pos.x && ipos.x < block.pos.x + blocksize
+            && ipos.y >= block.pos.y && ipos.y < block.pos.y + blocksize;
+      };
+
+      if(wavefront){
+        Wavefront wf;
+        wf.descend<P>(block.in, inside, block.out);
+        block.in.clear();
+        return;
+      }
+
+      for(auto& drop: block.in){
+
+        while(true){
+
+          const ivec2 ipos = drop.pos;
+
+          if(!map.oob(ipos) && !inside(ipos)){
+            block.out.push_back(drop);
+            break;
+          }
+
+          if(!drop.template descend<P>())
+            break;
+
+        }
+
+      }
+
+      block.in.clear();
+
+    });
+
+    // Hand-Off Drops which left their Block
+
+    for(auto& block: blocks){
+      for(auto& drop: block.out)
+        blocks[index(drop.pos)].in.push_back(drop);
+      block.out.clear();
+    }
+
+    active = 0;
+    for(auto& block: blocks)
+      active += block.in.size();
+
+    map.page();
+
+    if(active == 0)
+      break;
+
+  }
+  }
+
+  track = NULL;
+  return drops;
+
 }
 
+/*
+  Per-Block Track Application:
+
+  With local tracks, the drops accumulate discharge and momentum into
+  the buffer of the block they are in. A cell is only ever written by
+  its own block, so its track is accumulated in the same order as with
+  the shared buffer, independent of the worker which took the block.
+  The tracks are applied to the fields chunk-wise in parallel (in the
+  cellpool order, for the hazard bitmap), and cleared for the next cycle.
+*/
+
+template<typename P>
+void World::reduce(){
+
+  const size_t per = quad::tilearea/quad::lodarea;
+  const size_t cells = quad::maparea*per;
+  const size_t chunk = (per < 4096) ? per : 4096;
+
+  const ivec2 bres = (quad::res + blocksize - 1)/blocksize;
+  const int bcells = blocksize >> quad::lodshift;
+
+  workers.foreach(cells/chunk, [&](const size_t k, const int t){
+
+    const size_t first = k*chunk;
+    quad::cellptr c = map.nodes[first/per].s.at(first%per);
+
+    const ivec2 origin = map.nodes[first/per].pos;
+
+    for(size_t i = first; i < first + chunk; i++, ++c){
+      const ivec2 pos = origin + quad::lodsize*math::cunflatten(i%per, quad::tileres/quad::lodsize);
+      Block& block = blocks[math::flatten(pos/blocksize, bres)];
+      const ivec2 l = (pos - block.pos) >> quad::lodshift;
+      vec3& track = block.track[l.x*bcells + l.y];
+      if(track.x != 0.0f || track.y != 0.0f || track.z != 0.0f)
+        map.mark(c);
+      c->discharge = (1.0f-P::lrate)*c->discharge + P::lrate*track.x;
+      c->momentumx = (1.0f-P::lrate)*c->momentumx + P::lrate*track.y;
+      c->momentumy = (1.0f-P::lrate)*c->momentumy + P::lrate*track.z;
+      Vegetation::hazard.update(i, pos, c->discharge, c->height);
+      track = vec3(0);
+    }
+
+    map.touch(&map.nodes[first/per]);
+
+  });
+
+  map.page();
+
+}
+
+template<typename P>
 void World::cascade(vec2 pos){
 
-  // Get Non-Out-of-Bounds Neighbors
-
-  static const ivec2 n[] = {
-    ivec2(-1, -1),
-    ivec2(-1,  0),
-    ivec2(-1,  1),
-    ivec2( 0, -1),
-    ivec2( 0,  1),
-    ivec2( 1, -1),
-    ivec2( 1,  0),
-    ivec2( 1,  1)
-  };
+  quad::stencil st;
+  if(st.load(map, pos))
+    cascade<P>(st);
 
-  struct Point {
-    ivec2 pos;
-    float h;
-    float d;
-  };
+}
 
-  static Point sn[8];
-  int num = 0;
+/*
+  The 8 neighbors are sorted by height with a sorting network. Ties are
+  broken by the neighbor order, so the result matches a stable sort.
+  Heights in the stencil are kept in sync with the cells.
+*/
 
-  ivec2 ipos = pos;
+template<typename P>
+void World::cascade(quad::stencil& st){
 
-  for(auto& nn: n){
+  // Non-Out-of-Bounds Neighbors
 
-    ivec2 npos = ipos + quad::lodsize*nn;
+  static const int n[] = {
+    quad::stencil::index(-1, -1),
+    quad::stencil::index(-1,  0),
+    quad::stencil::index(-1,  1),
+    quad::stencil::index( 0, -1),
+    quad::stencil::index( 0,  1),
+    quad::stencil::index( 1, -1),
+    quad::stencil::index( 1,  0),
+    quad::stencil::index( 1,  1)
+  };
 
-    if(World::map.oob(npos))
-      continue;
+  static const float d[] = {
+    length(vec2(-1, -1)),
+    length(vec2(-1,  0)),
+    length(vec2(-1,  1)),
+    length(vec2( 0, -1)),
+    length(vec2( 0,  1)),
+    length(vec2( 1, -1)),
+    length(vec2( 1,  0)),
+    length(vec2( 1,  1))
+  };
 
-    sn[num++] = { npos, World::map.get(npos)->get(npos)->height, length(vec2(nn)) };
+  float key[8];
+  int sn[8];
+  int num = 0;
 
+  for(int k = 0; k < 8; k++){
+    sn[k] = k;
+    if(st.c[n[k]] == NULL) key[k] = std::numeric_limits<float>::infinity();
+    else {
+      key[k] = st.h[n[k]];
+      num++;
+    }
   }
 
+  // Sorting Network (19 Comparators)
+
+  auto exchange = [&](const int a, const int b){
+    if(key[b] < key[a] || (key[b] == key[a] && sn[b] < sn[a])){
+      std::swap(key[a], key[b]);
+      std::swap(sn[a], sn[b]);
+    }
+  };
+
+  exchange(0, 2); exchange(1, 3); exchange(4, 6); exchange(5, 7);
+  exchange(0, 4); exchange(1, 5); exchange(2, 6); exchange(3, 7);
+  exchange(0, 1); exchange(2, 3); exchange(4, 5); exchange(6, 7);
+  exchange(2, 4); exchange(3, 5);
+  exchange(1, 4); exchange(3, 6);
+  exchange(1, 2); exchange(3, 4); exchange(5, 6);
+
   //Iterate over all sorted Neighbors
 
-  sort(std::begin(sn), std::begin(sn) + num, [&](const Point& a, const Point& b){
-    return a.h < b.h;
-  });
+  float& h = st.h[4];
+  bool changed = false;
+  int transfers = 0;
 
   for (int i = 0; i < num; ++i) {
 
-    auto& npos = sn[i].pos;
+    const int k = n[sn[i]];
 
     //Full Height-Different Between Positions!
-    float diff = World::map.get(ipos)->get(ipos)->height - sn[i].h;
+    float diff = h - key[i];
     if(diff == 0)   //No Height Difference
       continue;
 
       //The Amount of Excess Difference!
     float excess = 0.0f;
-    if(sn[i].h > 0.1){
-      excess = abs(diff) - sn[i].d*maxdiff * quad::lodsize;
+    if(key[i] > 0.1){
+      excess = abs(diff) - d[sn[i]]*P::maxdiff * quad::lodsize;
     } else {
       excess = abs(diff);
     }
@@ -151,18 +544,34 @@ void World::cascade(vec2 pos){
       continue;
 
     //Actual Amount Transferred
-    float transfer = settling * excess / 2.0f;
+    float transfer = P::settling * excess / 2.0f;
+
+    changed = true;
+    transfers++;
 
     //Cap by Maximum Transferrable Amount
     if(diff > 0){
-      World::map.get(ipos)->get(ipos)->height -= transfer;
-      World::map.get(npos)->get(npos)->height += transfer;
+      h -= transfer;
+      st.h[k] += transfer;
     }
     else{
-      World::map.get(ipos)->get(ipos)->height += transfer;
-      World::map.get(npos)->get(npos)->height -= transfer;
+      h += transfer;
+      st.h[k] -= transfer;
     }
 
+    st.c[4]->height = h;
+    st.c[k]->height = st.h[k];
+    World::map.mark(st.c[k]);
+
+  }
+
+  stats::count(stats::TRANSFERS, transfers);
+
+  // Neighbor Heights Changed: Normals up to 2 Cells Away
+
+  if(changed){
+    World::map.invalidate(st.pos, 2);
+    World::map.mark(st.c[4]);
   }
 
 }